@@ -4,6 +4,33 @@
 #include <cassert>
 #include <exception>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <unordered_map>
+#include <memory>
+#include <new>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <cfloat>
+#include <climits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if __cplusplus >= 202002L
+#include <ranges>
+#endif
 
 using namespace std;
 
@@ -11,12 +38,433 @@ using namespace std;
 #define MAX_HEALTH 1000
 #define MAX_POWER 500
 
+#define ID_NODE_BITS 11
+#define ID_EPOCH_BITS 12
+#define ID_SEQUENCE_BITS 39
+#define ID_BLOCK_SIZE 65536
+#define ID_LEASE_SIZE 1000000
+#define ID_LEASE_BLOCKS 16
+#define ID_LEASE_MAGIC 0x45534c49u
+
+/**
+ * @brief A 64-bit character ID: [node:11][epoch:12][minted by IdMinter:1][sequence:39].
+ * 
+ * Node and epoch make IDs unique across processes and restarts; the sequence counts IDs
+ * within one node and epoch. The top bit stays clear, so IDs are never negative.
+ */
+typedef int64_t CharacterId;
+
+/**
+ * @brief Assembles a character ID from its parts.
+ * 
+ * @param node The node (process) the ID is minted on.
+ * @param epoch The epoch of the node, e.g. incremented on every restart.
+ * @param minted True for IDs handed out in blocks by an IdMinter.
+ * @param sequence The position of the ID in its node and epoch.
+ * @return The ID.
+ * @throw std::invalid_argument If a part does not fit into its field.
+ */
+inline CharacterId composeCharacterId(uint32_t node, uint32_t epoch, bool minted, int64_t sequence) {
+    if (node >= 1u << ID_NODE_BITS || epoch >= 1u << ID_EPOCH_BITS) {
+        throw invalid_argument("Node must be below " + to_string(1u << ID_NODE_BITS) + " and epoch below "
+                               + to_string(1u << ID_EPOCH_BITS) + ".");
+    }
+    if (sequence < 0 || sequence >= 1LL << ID_SEQUENCE_BITS) {
+        throw invalid_argument("ID sequence number out of range.");
+    }
+    return (CharacterId)node << (ID_EPOCH_BITS + 1 + ID_SEQUENCE_BITS)
+         | (CharacterId)epoch << (1 + ID_SEQUENCE_BITS)
+         | (CharacterId)minted << ID_SEQUENCE_BITS
+         | sequence;
+}
+
+/**
+ * @class IdLeaseFile
+ * @brief Durably leases ranges of ID sequence numbers through a small memory-mapped file.
+ * 
+ * The control file only stores the first sequence number that has not been leased yet.
+ * Every lease advances it and flushes the page to disk before the range is used, so after a
+ * restart no ID of a previous run can be handed out again, and resuming costs O(1) no matter
+ * how many characters were saved. IDs left unused in the last lease before a restart are
+ * skipped. IdMinter blocks are leased the same way, ID_LEASE_BLOCKS blocks at a time.
+ */
+class IdLeaseFile {
+public:
+    /**
+     * @brief Opens or creates a control file.
+     * 
+     * A new or empty file is initialized; any other file is left untouched unless it is a
+     * control file.
+     * 
+     * @param path The path of the control file.
+     * @param leaseSize The number of sequence numbers reserved by one lease.
+     * @throw std::runtime_error If the file cannot be opened or mapped, or has another format.
+     */
+    IdLeaseFile(const string &path, int64_t leaseSize = ID_LEASE_SIZE) : size(leaseSize) {
+        fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        struct stat status;
+        if (fd < 0 || fstat(fd, &status) != 0) {
+            closeFile();
+            throw runtime_error("Cannot open ID lease file " + path + ".");
+        }
+        if (status.st_size != 0 && status.st_size != (off_t)sizeof(Control)) {
+            closeFile();
+            throw runtime_error("Not an ID lease file: " + path + ".");
+        }
+        if (status.st_size == 0 && ftruncate(fd, sizeof(Control)) != 0) {
+            closeFile();
+            throw runtime_error("Cannot open ID lease file " + path + ".");
+        }
+        void *mapped = mmap(nullptr, sizeof(Control), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            closeFile();
+            throw runtime_error("Cannot map ID lease file " + path + ".");
+        }
+        control = static_cast<Control *>(mapped);
+        if (status.st_size == 0) {
+            control->magic = ID_LEASE_MAGIC;
+            control->nextUnleased = 0;
+            control->nextBlock = 0;
+            flush();
+        } else if (control->magic != ID_LEASE_MAGIC) {
+            munmap(control, sizeof(Control));
+            closeFile();
+            throw runtime_error("Not an ID lease file: " + path + ".");
+        }
+    }
+
+    IdLeaseFile(const IdLeaseFile &) = delete;
+    IdLeaseFile &operator=(const IdLeaseFile &) = delete;
+
+    /**
+     * @brief Destructor to unmap and close the control file.
+     */
+    ~IdLeaseFile() {
+        munmap(control, sizeof(Control));
+        closeFile();
+    }
+
+    /**
+     * @brief Durably reserves the next range of sequence numbers.
+     * 
+     * @param minimum The lowest sequence number the range may start at.
+     * @return The first sequence number of the range; the range has leaseSize() numbers.
+     * @throw std::runtime_error If the control file cannot be flushed.
+     */
+    int64_t leaseFrom(int64_t minimum) {
+        int64_t first = max(minimum, control->nextUnleased);
+        control->nextUnleased = first + size;
+        flush();
+        return first;
+    }
+
+    /**
+     * @brief Durably reserves the next ID_LEASE_BLOCKS IdMinter blocks.
+     * 
+     * @param minimum The lowest block number the range may start at.
+     * @return The first block number of the range.
+     * @throw std::runtime_error If the control file cannot be flushed.
+     */
+    int64_t leaseBlocks(int64_t minimum) {
+        int64_t first = max(minimum, control->nextBlock);
+        control->nextBlock = first + ID_LEASE_BLOCKS;
+        flush();
+        return first;
+    }
+
+    /**
+     * @brief Gets the first IdMinter block that has not been leased yet.
+     * @return The next unleased block number.
+     */
+    int64_t nextUnleasedBlock() const {
+        return control->nextBlock;
+    }
+
+    /**
+     * @brief Gets the first sequence number that has not been leased yet.
+     * @return The next unleased sequence number.
+     */
+    int64_t nextUnleased() const {
+        return control->nextUnleased;
+    }
+
+    /**
+     * @brief Gets the number of sequence numbers reserved by one lease.
+     * @return The lease size.
+     */
+    int64_t leaseSize() const {
+        return size;
+    }
+
+private:
+    struct Control {
+        uint32_t magic;
+        uint32_t reserved;
+        int64_t nextUnleased;
+        int64_t nextBlock;
+    };
+
+    int fd;
+    Control *control;
+    int64_t size;
+
+    void flush() {
+        if (msync(control, sizeof(Control), MS_SYNC) != 0) {
+            throw runtime_error("Cannot flush ID lease file.");
+        }
+    }
+
+    void closeFile() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+/**
+ * @brief Receives every change of the characters of a world, e.g. to record a replay.
+ * 
+ * The store, the pool and pooled GameCharacter objects report their changes here as they
+ * make them, so changes made through their mutators cannot bypass the journal. Store rows
+ * are spawned and despawned, pooled GameCharacter objects are created and destroyed.
+ * Standalone GameCharacter objects are not part of a replay and are not journaled; neither
+ * are writes to public fields or columns.
+ */
+struct CharacterJournal {
+    virtual ~CharacterJournal() {}
+    virtual void spawn(CharacterId id, const string &name, int health, int attackPower) = 0;
+    virtual void create(CharacterId id, const string &name, int health, int attackPower) = 0;
+    virtual void rename(CharacterId id, const string &name) = 0;
+    virtual void damage(CharacterId id, int amount) = 0;
+    virtual void set(CharacterId id, int health, int attackPower) = 0;
+    virtual void despawn(CharacterId id) = 0;
+    virtual void destroy(CharacterId id) = 0;
+};
+
+/**
+ * @brief The ID allocator and live object count of one world of characters.
+ * 
+ * The world's own thread takes sequential IDs from uniqueId. Other threads use an IdMinter,
+ * which reserves whole blocks from nextBlock in a separate part of the sequence space. With
+ * an IdLeaseFile attached, sequential IDs and minter blocks come from durably leased ranges,
+ * and uniqueId is the next sequence number rather than the number of IDs handed out.
+ */
+struct CharacterCounters {
+    int64_t uniqueId = 0;
+    int objectCount = 0;
+    uint32_t node = 0;
+    uint32_t epoch = 0;
+    atomic<int64_t> nextBlock{0};
+    IdLeaseFile *lease = nullptr;
+    int64_t leaseEnd = 0;
+    int64_t blockLeaseEnd = 0;
+    atomic_flag blockLock = ATOMIC_FLAG_INIT;
+
+    /**
+     * @brief Sum of the characterHash() of every live character and store row of the world, modulo 2^64.
+     */
+    uint64_t checksum = 0;
+
+    /**
+     * @brief Journal of the world's changes, or null when they are not recorded.
+     */
+    CharacterJournal *journal = nullptr;
+
+    /**
+     * @brief Hands out the next sequential ID of the world.
+     * @return The new ID.
+     * @throw std::runtime_error If a new lease cannot be stored or the sequence is exhausted.
+     */
+    CharacterId mintId() {
+        if (lease != nullptr && uniqueId >= leaseEnd) {
+            renewLease();
+        }
+        if (uniqueId >= 1LL << ID_SEQUENCE_BITS) {
+            throw runtime_error("Character IDs of this node and epoch are exhausted.");
+        }
+        CharacterId id = composeCharacterId(node, epoch, false, uniqueId);
+        ++uniqueId;
+        return id;
+    }
+
+    /**
+     * @brief Takes sequential IDs from durably leased ranges from now on.
+     * @param file The lease control file; it must outlive the counters or be detached.
+     */
+    void useLease(IdLeaseFile *file) {
+        lease = file;
+        leaseEnd = uniqueId;
+        blockLeaseEnd = nextBlock;
+    }
+
+    /**
+     * @brief Reserves the next block of ID_BLOCK_SIZE minted sequence numbers; safe on any thread.
+     * @return The block number.
+     * @throw std::runtime_error If a new lease cannot be stored.
+     */
+    int64_t takeBlock() {
+        if (lease == nullptr) {
+            return nextBlock.fetch_add(1, memory_order_relaxed);
+        }
+        while (blockLock.test_and_set(memory_order_acquire)) {
+        }
+        int64_t block = nextBlock.load();
+        try {
+            if (block >= blockLeaseEnd) {
+                block = lease->leaseBlocks(block);
+                blockLeaseEnd = block + ID_LEASE_BLOCKS;
+            }
+        } catch (...) {
+            blockLock.clear(memory_order_release);
+            throw;
+        }
+        nextBlock = block + 1;
+        blockLock.clear(memory_order_release);
+        return block;
+    }
+
+    /**
+     * @brief Makes sure this world never hands out an ID that was created elsewhere.
+     * @param id An ID taken over from another world.
+     */
+    void reserve(CharacterId id) {
+        int64_t sequence = id & ((1LL << ID_SEQUENCE_BITS) - 1);
+        if (id >> ID_SEQUENCE_BITS == composeCharacterId(node, epoch, false, 0) >> ID_SEQUENCE_BITS) {
+            uniqueId = max(uniqueId, sequence + 1);
+            if (lease != nullptr && uniqueId > leaseEnd) {
+                renewLease();
+            }
+        } else if (id >> ID_SEQUENCE_BITS == composeCharacterId(node, epoch, true, 0) >> ID_SEQUENCE_BITS) {
+            int64_t block = sequence / ID_BLOCK_SIZE + 1;
+            int64_t current = nextBlock.load();
+            while (current < block && !nextBlock.compare_exchange_weak(current, block)) {
+            }
+        }
+    }
+
+    /**
+     * @brief Checks whether an ID may already have been handed out by this world.
+     * 
+     * IDs of other nodes and epochs never were; IDs of this node and epoch were if they lie
+     * below the next sequential ID or inside a block reserved by an IdMinter.
+     * 
+     * @param id The ID to check.
+     * @return True if a character of this world may carry the ID.
+     */
+    bool mayBeLive(CharacterId id) const {
+        int64_t sequence = id & ((1LL << ID_SEQUENCE_BITS) - 1);
+        if (id >> ID_SEQUENCE_BITS == composeCharacterId(node, epoch, false, 0) >> ID_SEQUENCE_BITS) {
+            return sequence < uniqueId;
+        }
+        if (id >> ID_SEQUENCE_BITS == composeCharacterId(node, epoch, true, 0) >> ID_SEQUENCE_BITS) {
+            return sequence < nextBlock.load() * ID_BLOCK_SIZE;
+        }
+        return false;
+    }
+
+private:
+    void renewLease() {
+        uniqueId = lease->leaseFrom(uniqueId);
+        leaseEnd = uniqueId + lease->leaseSize();
+    }
+};
+
+/**
+ * @class IdMinter
+ * @brief Mints character IDs on any thread without coordinating for each ID.
+ * 
+ * A minter reserves a block of ID_BLOCK_SIZE sequence numbers with a single atomic increment
+ * of its world's block counter and then hands them out locally. Every thread that creates
+ * characters concurrently uses its own minter.
+ */
+class IdMinter {
+public:
+    /**
+     * @brief Constructor to create a minter for a world.
+     * @param counters The counters of the world the IDs belong to.
+     */
+    IdMinter(CharacterCounters &counters) : counters(&counters), next(0), end(0) {}
+
+    /**
+     * @brief Hands out a new ID.
+     * @return The new ID.
+     * @throw std::runtime_error If the minted sequence of the node and epoch is exhausted or a
+     *        new block lease cannot be stored.
+     */
+    CharacterId mint() {
+        if (next == end) {
+            next = counters->takeBlock() * ID_BLOCK_SIZE;
+            if (next >= 1LL << ID_SEQUENCE_BITS) {
+                next = end;
+                throw runtime_error("Minted character IDs of this node and epoch are exhausted.");
+            }
+            end = next + ID_BLOCK_SIZE;
+        }
+        return composeCharacterId(counters->node, counters->epoch, true, next++);
+    }
+
+private:
+    CharacterCounters *counters;
+    int64_t next;
+    int64_t end;
+};
+
+/**
+ * @brief Hashes the name part of characterHash(), so that it can be kept per character.
+ * 
+ * @param name The name bytes.
+ * @param length The number of bytes.
+ * @return The FNV-1a hash of the name.
+ */
+inline uint64_t characterNameHash(const char *name, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (unsigned char)name[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Completes characterHash() from a name hash and the other attributes.
+ * 
+ * @param nameHash The characterNameHash() of the name.
+ * @param id The unique ID of the character.
+ * @param health The health points of the character.
+ * @param attackPower The attack power of the character.
+ * @return The hash.
+ */
+inline uint64_t mixCharacterHash(uint64_t nameHash, CharacterId id, int health, int attackPower) {
+    uint64_t hash = nameHash;
+    hash ^= (uint64_t)id * 0x9e3779b97f4a7c15ULL;
+    hash ^= ((uint64_t)(uint32_t)health << 32 | (uint32_t)attackPower) * 0xc2b2ae3d27d4eb4fULL;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+/**
+ * @brief Hashes the state of one character for the world checksum.
+ * 
+ * The name goes through FNV-1a and everything is mixed with the SplitMix64 finalizer, so that
+ * sums of hashes of different populations are unlikely to collide.
+ * 
+ * @param id The unique ID of the character.
+ * @param name The name of the character.
+ * @param health The health points of the character.
+ * @param attackPower The attack power of the character.
+ * @return The hash.
+ */
+inline uint64_t characterHash(CharacterId id, const string &name, int health, int attackPower) {
+    return mixCharacterHash(characterNameHash(name.data(), name.size()), id, health, attackPower);
+}
+
 /**
  * @class GameCharacter
  * @brief Represents a character in a game with attributes such as name, health, and attack power.
  * 
  * This class manages a game character's attributes and ensures validation of values. 
  * Each character instance is assigned a unique ID, and the total count of active objects is tracked.
+ * Characters can be moved but not copied or assigned, since a copy would share the unique ID.
  * 
  * Made by: Aleksandra Nikitkova
  */
@@ -26,17 +474,18 @@ public:
     int health;
     int attackPower;
 
-    int id;
+    CharacterId id;
     
-    static int uniqueId;
-    static int ObjectCount;
+    static CharacterCounters defaultCounters;
+    static int64_t &uniqueId;
+    static int &ObjectCount;
 
     /**
      * @brief Constructor to initialize a character with default attributes.
      * 
      * The name set to "Name", health is set to -1 (invincible), and the attack power is set to 0.
      */
-    GameCharacter() {
+    GameCharacter() : counters(&defaultCounters) {
         init("Name", -1, 0);
     }
 
@@ -48,15 +497,70 @@ public:
      * @param attackPower The attack power of the character.
      * @throw std::invalid_argument If name, health, or attack power is invalid.
      */
-    GameCharacter(string name, int health, int attackPower) {
+    GameCharacter(string name, int health, int attackPower) : counters(&defaultCounters) {
+        init(name, health, attackPower);
+    }
+
+    /**
+     * @brief Constructor to initialize a character that belongs to a specific world.
+     * 
+     * The ID is taken from, and the object is counted in, the given counters instead of the
+     * default ones.
+     * 
+     * @param counters The counters of the character's world.
+     * @param name The name of the character.
+     * @param health The health points of the character (positive value or -1 for invincible).
+     * @param attackPower The attack power of the character.
+     * @throw std::invalid_argument If name, health, or attack power is invalid.
+     */
+    GameCharacter(CharacterCounters &counters, string name, int health, int attackPower) : counters(&counters) {
         init(name, health, attackPower);
     }
 
+    /**
+     * @brief Constructor to initialize a character of a specific world with a known ID.
+     * 
+     * Used to restore characters, e.g. when a replay is played back. The world's counters
+     * are moved past the ID.
+     * 
+     * @param counters The counters of the character's world.
+     * @param id The unique ID of the character.
+     * @param name The name of the character.
+     * @param health The health points of the character (positive value or -1 for invincible).
+     * @param attackPower The attack power of the character.
+     * @throw std::invalid_argument If name, health, or attack power is invalid.
+     */
+    GameCharacter(CharacterCounters &counters, CharacterId id, string name, int health, int attackPower)
+        : counters(&counters) {
+        validate(name, health, attackPower);
+        counters.reserve(id);
+        assign(id, name, health, attackPower);
+    }
+
+    /**
+     * @brief Move constructor used to relocate a character, keeping its unique ID.
+     * 
+     * The moved-from object is still counted until it is destroyed, so the object count is
+     * increased here as for any other new object.
+     * 
+     * @param other The character to move from.
+     */
+    GameCharacter(GameCharacter &&other) noexcept
+        : name(move(other.name)), health(other.health), attackPower(other.attackPower), id(other.id),
+          counters(other.counters), hash(other.hash), pooled(other.pooled) {
+        ++counters->objectCount;
+        counters->checksum += hash;
+    }
+
+    GameCharacter(const GameCharacter &) = delete;
+    GameCharacter &operator=(const GameCharacter &) = delete;
+
     /**
      * @brief Destructor to decrement the object count when a character is deleted.
      */
     ~GameCharacter() {
-        --ObjectCount;
+        --counters->objectCount;
+        counters->checksum -= hash;
     }
 
     /**
@@ -71,6 +575,10 @@ public:
     void setName(string characterName) {
         validateName(characterName);
         name = characterName;
+        rehash();
+        if (pooled && counters->journal != nullptr) {
+            counters->journal->rename(id, name);
+        }
     }
 
     /**
@@ -101,7 +609,7 @@ public:
      * @brief Gets the unique ID of the character.
      * @return The unique ID of the character.
      */
-    int getPersonalId() {
+    CharacterId getPersonalId() {
         return id;
     }
 
@@ -127,27 +635,81 @@ public:
      * @brief Gets the total number of characters created.
      * @return The total number of character instances ever created.
      */
-    static int getIdCount() {
+    static int64_t getIdCount() {
         return uniqueId;
     }
 
+    /**
+     * @brief Validates a full set of character attributes without creating a character.
+     * 
+     * Used by bulk containers that store characters outside of GameCharacter objects.
+     * 
+     * @param name The name of the character.
+     * @param health The health points of the character.
+     * @param attackPower The attack power of the character.
+     * @throw std::invalid_argument If name, health, or attack power is invalid.
+     */
+    static void validate(string name, int health, int attackPower) {
+        validateName(name);
+        validateHealth(health);
+        validateAttackPower(attackPower);
+    }
+
 private:
+    CharacterCounters *counters;
+
+    /**
+     * @brief The share of this character in the world checksum.
+     */
+    uint64_t hash = 0;
+
+    /**
+     * @brief Whether the character lives in a CharacterPool, whose journal knows its creation.
+     */
+    bool pooled = false;
+
+    friend class CharacterPool;
+
     /**
      * @brief Initializes the GameCharacter object with the provided attributes.
      * 
      * This method sets the character's name, health, and attack power while also
-     * assigning a unique ID and increasing the object count.
+     * assigning a unique ID, increasing the object count and adding the character
+     * to the world checksum. Nothing is changed if an attribute is invalid.
      * 
      * @param name The name of the character.
      * @param health The health points of the character.
      * @param attackPower The attack power of the character.
      */
     void init(string name, int health, int attackPower) {
-        setName(name);
-        setHealth(health);
-        setAttackPower(attackPower);
-        id = uniqueId++;
-        ++ObjectCount;
+        validate(name, health, attackPower);
+        assign(counters->mintId(), name, health, attackPower);
+    }
+
+    /**
+     * @brief Sets the validated attributes and the ID, counts the object and adds it to the checksum.
+     * 
+     * @param id The unique ID of the character.
+     * @param name The name of the character.
+     * @param health The health points of the character.
+     * @param attackPower The attack power of the character.
+     */
+    void assign(CharacterId id, string name, int health, int attackPower) {
+        this->name = name;
+        this->health = health;
+        this->attackPower = attackPower;
+        this->id = id;
+        ++counters->objectCount;
+        rehash();
+    }
+
+    /**
+     * @brief Replaces the character's share of the world checksum after a change.
+     */
+    void rehash() {
+        counters->checksum -= hash;
+        hash = characterHash(id, name, health, attackPower);
+        counters->checksum += hash;
     }
 
     /**
@@ -161,6 +723,7 @@ private:
     void setHealth(int characterHealth) {
         validateHealth(characterHealth);
         health = characterHealth;
+        rehash();
     }
 
     /**
@@ -172,6 +735,7 @@ private:
     void setAttackPower(int characterAttackPower) {
         validateAttackPower(characterAttackPower);
         attackPower = characterAttackPower;
+        rehash();
     }
 
     /**
@@ -183,7 +747,7 @@ private:
      * @param characterHealth The health value to set.
      * @throw std::invalid_argument If the health value is invalid.
      */
-    void validateHealth(int characterHealth) {
+    static void validateHealth(int characterHealth) {
         if (characterHealth <= 0 && characterHealth != -1) {
             throw invalid_argument("Health must be positive or -1 for invincible character.");
         }
@@ -201,7 +765,7 @@ private:
      * @param characterAttackPower The attack power value to set.
      * @throw std::invalid_argument If the attack power exceeds the allowed limit.
      */
-    void validateAttackPower(int characterAttackPower) {
+    static void validateAttackPower(int characterAttackPower) {
         if (characterAttackPower > MAX_POWER) {
             throw invalid_argument("Attack power cannot exceed " + to_string(MAX_POWER) + ".");
         }
@@ -216,7 +780,7 @@ private:
      * @param characterName The new name for the character.
      * @throw std::invalid_argument If the name does not meet the validation criteria.
      */
-    void validateName(string characterName) {
+    static void validateName(string characterName) {
         if (characterName == "") {
             throw invalid_argument("Character name cannot be empty.");
         }
@@ -245,57 +809,7775 @@ private:
     }
 };
 
-int GameCharacter::uniqueId = 0;
-int GameCharacter::ObjectCount = 0;
-
-int main() {
-    try {
-        assert(GameCharacter::getObjectCount() == 0);
+CharacterCounters GameCharacter::defaultCounters;
+int64_t &GameCharacter::uniqueId = GameCharacter::defaultCounters.uniqueId;
+int &GameCharacter::ObjectCount = GameCharacter::defaultCounters.objectCount;
 
-        GameCharacter *npc[3];
+/**
+ * @brief Observer policy that does nothing; every hook compiles away.
+ */
+struct NoObservers {
+    static void onInit(GameCharacter &) {}
+    static void onRename(GameCharacter &, const string &) {}
+    static void onDestroy(GameCharacter &) {}
+};
 
-        npc[0] = new GameCharacter("Leonardo da Vinci", 1000, 20);
+/**
+ * @brief Observer policy that forwards every hook to several policies in order.
+ */
+template <class... Observers>
+struct ObserverList {
+    static void onInit(GameCharacter &character) {
+        (Observers::onInit(character), ...);
+    }
 
-        assert(npc[0]->toString() == "Leonardo da Vinci 1000 20");
-        assert(GameCharacter::getObjectCount() == 1);
+    static void onRename(GameCharacter &character, const string &oldName) {
+        (Observers::onRename(character, oldName), ...);
+    }
 
-        assert(npc[0]->getPersonalId() == 0);
-        assert(npc[0]->getName() == "Leonardo da Vinci");
-        assert(npc[0]->getHealth() == 1000);
-        assert(npc[0]->getAttackPower() == 20);
-    
-        npc[1] = new GameCharacter();
+    static void onDestroy(GameCharacter &character) {
+        (Observers::onDestroy(character), ...);
+    }
+};
 
-        assert(npc[1]->toString() == "Name -1 0");
-        assert(GameCharacter::getObjectCount() == 2);
-        assert(GameCharacter::getIdCount() == 2);
-    
-        assert(npc[1]->getPersonalId() == 1);
-        assert(npc[1]->getName() == "Name");
-        assert(npc[1]->getHealth() == -1);
-        assert(npc[1]->getAttackPower() == 0);
+/**
+ * @brief Observer policy that counts lifecycle events, e.g. for metrics.
+ */
+struct LifecycleCounters {
+    static long long inits;
+    static long long renames;
+    static long long destroys;
 
-        npc[1]->setName("B");
-        assert(npc[1]->getName() == "B");
+    static void onInit(GameCharacter &) {
+        ++inits;
+    }
 
-        npc[2] = new GameCharacter("Jack", 10, 30);
+    static void onRename(GameCharacter &, const string &) {
+        ++renames;
+    }
 
-        assert(GameCharacter::getObjectCount() == 3);
-        assert(GameCharacter::getIdCount() == 3);
-    
-        assert(npc[2]->getPersonalId() == 2);
-        assert(npc[2]->getName() == "Jack");
-        assert(npc[2]->getHealth() == 10);
-        assert(npc[2]->getAttackPower() == 30);
+    static void onDestroy(GameCharacter &) {
+        ++destroys;
+    }
+};
 
+long long LifecycleCounters::inits = 0;
+long long LifecycleCounters::renames = 0;
+long long LifecycleCounters::destroys = 0;
 
-        for (int i = 0; i < 3; ++i) {
+/**
+ * @brief Observer policy backed by a runtime registry of callbacks.
+ * 
+ * For subsystems that are only known at run time. Each hook costs a loop over the registered
+ * callbacks, so compile-time policies are preferred where possible.
+ */
+struct RuntimeObservers {
+    static vector<function<void(GameCharacter &)>> initHooks;
+    static vector<function<void(GameCharacter &, const string &)>> renameHooks;
+    static vector<function<void(GameCharacter &)>> destroyHooks;
+
+    static void onInit(GameCharacter &character) {
+        for (auto &hook : initHooks) {
+            hook(character);
+        }
+    }
+
+    static void onRename(GameCharacter &character, const string &oldName) {
+        for (auto &hook : renameHooks) {
+            hook(character, oldName);
+        }
+    }
+
+    static void onDestroy(GameCharacter &character) {
+        for (auto &hook : destroyHooks) {
+            hook(character);
+        }
+    }
+};
+
+vector<function<void(GameCharacter &)>> RuntimeObservers::initHooks;
+vector<function<void(GameCharacter &, const string &)>> RuntimeObservers::renameHooks;
+vector<function<void(GameCharacter &)>> RuntimeObservers::destroyHooks;
+
+/**
+ * @class ObservedCharacter
+ * @brief A GameCharacter that reports its lifecycle to a compile-time observer policy.
+ * 
+ * The policy provides static onInit(), onRename() and onDestroy() functions, which are called
+ * directly and inlined. GameCharacter itself is unchanged, so characters without observers
+ * compile to exactly the same code as before. Hooks only fire when the character is renamed
+ * and destroyed through its ObservedCharacter type, not through a GameCharacter pointer.
+ */
+template <class Observer>
+class ObservedCharacter : public GameCharacter {
+public:
+    /**
+     * @brief Constructor to initialize a character with default attributes.
+     */
+    ObservedCharacter() {
+        Observer::onInit(*this);
+    }
+
+    /**
+     * @brief Constructor to initialize a character with a name, health, and attack power.
+     * 
+     * @param name The name of the character.
+     * @param health The health points of the character (positive value or -1 for invincible).
+     * @param attackPower The attack power of the character.
+     * @throw std::invalid_argument If name, health, or attack power is invalid.
+     */
+    ObservedCharacter(string name, int health, int attackPower) : GameCharacter(name, health, attackPower) {
+        Observer::onInit(*this);
+    }
+
+    /**
+     * @brief Destructor to notify the observers before the character is destroyed.
+     */
+    ~ObservedCharacter() {
+        Observer::onDestroy(*this);
+    }
+
+    /**
+     * @brief Sets the character's name with validation and notifies the observers.
+     * 
+     * @param characterName The new name for the character.
+     * @throw std::invalid_argument If the name is invalid.
+     */
+    void setName(string characterName) {
+        string oldName = name;
+        GameCharacter::setName(characterName);
+        Observer::onRename(*this, oldName);
+    }
+};
+
+/**
+ * @brief Character class of the uppercase letters A-Z.
+ */
+struct UpperCase {
+    static constexpr bool contains(unsigned char c) {
+        return c >= 'A' && c <= 'Z';
+    }
+};
+
+/**
+ * @brief Character class of the lowercase letters a-z.
+ */
+struct LowerCase {
+    static constexpr bool contains(unsigned char c) {
+        return c >= 'a' && c <= 'z';
+    }
+};
+
+/**
+ * @brief Character class of the digits 0-9.
+ */
+struct Digit {
+    static constexpr bool contains(unsigned char c) {
+        return c >= '0' && c <= '9';
+    }
+};
+
+/**
+ * @brief Character class containing only the space.
+ */
+struct Space {
+    static constexpr bool contains(unsigned char c) {
+        return c == ' ';
+    }
+};
+
+/**
+ * @brief Union of several character classes.
+ */
+template <class... Classes>
+struct AnyOf {
+    static constexpr bool contains(unsigned char c) {
+        return (Classes::contains(c) || ...);
+    }
+};
+
+/**
+ * @brief Complement of a character class.
+ */
+template <class Class>
+struct Not {
+    static constexpr bool contains(unsigned char c) {
+        return !Class::contains(c);
+    }
+};
+
+typedef AnyOf<UpperCase, LowerCase> Letter;
+
+/**
+ * @brief Declares an error message type for a validation rule.
+ */
+#define VALIDATION_MESSAGE(Name, expression) \
+    struct Name { \
+        static string text() { \
+            return expression; \
+        } \
+    };
+
+/**
+ * @brief When a validation rule is checked during the fused pass.
+ */
+enum RuleKind {
+    WHOLE_RULE, ///< Checked once before the pass, on the length or first character.
+    LAST_RULE,  ///< Checked on the last character, before the other rules at that position.
+    BYTE_RULE,  ///< Checked on every character, after the pair rules at that position.
+    PAIR_RULE   ///< Checked on every pair of adjacent characters, at the second one.
+};
+
+/**
+ * @brief Rule: the value must not be empty.
+ */
+template <class Message>
+struct NotEmpty {
+    typedef Message ErrorMessage;
+    static constexpr RuleKind kind = WHOLE_RULE;
+
+    static bool fails(const char *, size_t length) {
+        return length == 0;
+    }
+};
+
+/**
+ * @brief Rule: the value must not be longer than Limit characters.
+ */
+template <size_t Limit, class Message>
+struct MaxLength {
+    typedef Message ErrorMessage;
+    static constexpr RuleKind kind = WHOLE_RULE;
+
+    static bool fails(const char *, size_t length) {
+        return length > Limit;
+    }
+};
+
+/**
+ * @brief Rule: the first character must belong to a class.
+ */
+template <class Class, class Message>
+struct FirstIs {
+    typedef Message ErrorMessage;
+    static constexpr RuleKind kind = WHOLE_RULE;
+
+    static bool fails(const char *value, size_t length) {
+        return length != 0 && !Class::contains(value[0]);
+    }
+};
+
+/**
+ * @brief Rule: the last character must not belong to a class.
+ */
+template <class Class, class Message>
+struct NoTrailing {
+    typedef Message ErrorMessage;
+    static constexpr RuleKind kind = LAST_RULE;
+
+    static constexpr bool fails(unsigned char c) {
+        return Class::contains(c);
+    }
+};
+
+/**
+ * @brief Rule: every character must belong to a class.
+ */
+template <class Class, class Message>
+struct Alphabet {
+    typedef Message ErrorMessage;
+    static constexpr RuleKind kind = BYTE_RULE;
+
+    static constexpr bool fails(unsigned char c) {
+        return !Class::contains(c);
+    }
+};
+
+/**
+ * @brief Rule: a character of class Second must not follow a character of class First.
+ */
+template <class First, class Second, class Message>
+struct NoFollow {
+    typedef Message ErrorMessage;
+    static constexpr RuleKind kind = PAIR_RULE;
+
+    static constexpr bool first(unsigned char c) {
+        return First::contains(c);
+    }
+
+    static constexpr bool second(unsigned char c) {
+        return Second::contains(c);
+    }
+};
+
+/**
+ * @brief Rule: two adjacent characters must not both belong to a class.
+ */
+template <class Class, class Message>
+struct NoRepeat : NoFollow<Class, Class, Message> {};
+
+/**
+ * @brief The first rule a value violates, if any.
+ */
+struct RuleViolation {
+    int rule;        ///< Index of the violated rule in the rule list, or -1 if the value is valid.
+    size_t position; ///< Position of the offending character.
+};
+
+/**
+ * @class FusedValidator
+ * @brief Checks a string against a list of declarative rules in a single pass.
+ * 
+ * At compile time the per-character rules are folded into 256-entry lookup tables: for each
+ * byte, the first character or last-character rule it breaks and its membership bits for the
+ * two sides of the pair rules. The pass then needs one table lookup per character, whatever
+ * the number of rules. Violations are reported by rule, in the order the original
+ * hand-written checks use: whole-value rules first, then position by position, and at each
+ * position the last-character, pair and character rules in that order.
+ */
+template <class... Rules>
+class FusedValidator {
+public:
+    static constexpr int VALID = -1;
+
+    /**
+     * @brief Finds the first rule the value violates.
+     * @param value The characters to check.
+     * @param length The number of characters.
+     * @return The violated rule and its position, or rule VALID.
+     */
+    static RuleViolation check(const char *value, size_t length) {
+        RuleViolation violation = checkWhole(value, length, index_sequence_for<Rules...>());
+        if (violation.rule != VALID) {
+            return violation;
+        }
+        uint8_t previousPairs = 0;
+        for (size_t i = 0; i < length; ++i) {
+            unsigned char c = value[i];
+            if (i + 1 == length && tables.lastRule[c] != NO_RULE) {
+                return RuleViolation{tables.lastRule[c], i};
+            }
+            uint8_t followed = previousPairs & tables.secondBits[c];
+            if (followed != 0) {
+                return RuleViolation{tables.pairRule[__builtin_ctz(followed)], i};
+            }
+            if (tables.byteRule[c] != NO_RULE) {
+                return RuleViolation{tables.byteRule[c], i};
+            }
+            previousPairs = tables.firstBits[c];
+        }
+        return RuleViolation{VALID, length};
+    }
+
+    /**
+     * @brief Gets the error message of a rule.
+     * @param rule The index of the rule in the rule list.
+     * @return The message.
+     */
+    static string message(int rule) {
+        static string (*const messages[])() = {Rules::ErrorMessage::text...};
+        return messages[rule]();
+    }
+
+    /**
+     * @brief Validates a value against all rules.
+     * @param value The value to check.
+     * @throw std::invalid_argument With the message of the first violated rule.
+     */
+    static void validate(const string &value) {
+        RuleViolation violation = check(value.data(), value.size());
+        if (violation.rule != VALID) {
+            throw invalid_argument(message(violation.rule));
+        }
+    }
+
+private:
+    static constexpr uint8_t NO_RULE = 0xFF;
+
+    struct Tables {
+        uint8_t byteRule[256];
+        uint8_t lastRule[256];
+        uint8_t firstBits[256];
+        uint8_t secondBits[256];
+        uint8_t pairRule[8];
+    };
+
+    template <size_t Index, class Rule>
+    static constexpr void addRule(Tables &result, int &pairs) {
+        if constexpr (Rule::kind == BYTE_RULE || Rule::kind == LAST_RULE) {
+            uint8_t *table = Rule::kind == BYTE_RULE ? result.byteRule : result.lastRule;
+            for (int c = 0; c < 256; ++c) {
+                if (table[c] == NO_RULE && Rule::fails((unsigned char)c)) {
+                    table[c] = (uint8_t)Index;
+                }
+            }
+        } else if constexpr (Rule::kind == PAIR_RULE) {
+            for (int c = 0; c < 256; ++c) {
+                if (Rule::first((unsigned char)c)) {
+                    result.firstBits[c] |= (uint8_t)(1 << pairs);
+                }
+                if (Rule::second((unsigned char)c)) {
+                    result.secondBits[c] |= (uint8_t)(1 << pairs);
+                }
+            }
+            result.pairRule[pairs++] = (uint8_t)Index;
+        }
+    }
+
+    template <size_t... Index>
+    static constexpr Tables build(index_sequence<Index...>) {
+        Tables result{};
+        for (int c = 0; c < 256; ++c) {
+            result.byteRule[c] = NO_RULE;
+            result.lastRule[c] = NO_RULE;
+        }
+        int pairs = 0;
+        (addRule<Index, Rules>(result, pairs), ...);
+        return result;
+    }
+
+    template <size_t... Index>
+    static RuleViolation checkWhole(const char *value, size_t length, index_sequence<Index...>) {
+        RuleViolation violation = {VALID, 0};
+        auto checkRule = [&](int index, auto rule) {
+            typedef decltype(rule) Rule;
+            if constexpr (Rule::kind == WHOLE_RULE) {
+                if (violation.rule == VALID && Rule::fails(value, length)) {
+                    violation.rule = index;
+                }
+            }
+        };
+        (checkRule((int)Index, Rules()), ...);
+        return violation;
+    }
+
+    static_assert(sizeof...(Rules) < NO_RULE, "Too many validation rules.");
+    static constexpr Tables tables = build(index_sequence_for<Rules...>());
+};
+
+VALIDATION_MESSAGE(NameEmptyMessage, "Character name cannot be empty.")
+VALIDATION_MESSAGE(NameUppercaseMessage, "Name must start with an uppercase letter.")
+VALIDATION_MESSAGE(NameLengthMessage, "Name length cannot exceed " + to_string(MAX_NAME) + " characters.")
+VALIDATION_MESSAGE(NameTrailingSpaceMessage, "Invalid character name. Last character cannot be space.")
+VALIDATION_MESSAGE(NameAlphabetMessage, "Name must contain only alphabetic characters and spaces.")
+VALIDATION_MESSAGE(NameDoubleSpaceMessage, "Invalid character name. It should not contain spaces following another space.")
+
+/**
+ * @brief The name rules of GameCharacter::validateName() as a fused validator.
+ * 
+ * Reports the same messages as validateName(). Like the hand-written loop, it reports any
+ * character other than a letter right after a space as a repeated space, even when the
+ * character is not allowed at all.
+ */
+typedef FusedValidator<
+    NotEmpty<NameEmptyMessage>,
+    FirstIs<UpperCase, NameUppercaseMessage>,
+    MaxLength<MAX_NAME, NameLengthMessage>,
+    NoTrailing<Space, NameTrailingSpaceMessage>,
+    Alphabet<AnyOf<Letter, Space>, NameAlphabetMessage>,
+    NoFollow<Space, Not<Letter>, NameDoubleSpaceMessage>
+> NameValidator;
+
+#define DFA_LANES 4
+
+/**
+ * @brief Outcome codes of the DFA name validator.
+ */
+enum NameCheck {
+    NAME_VALID,
+    NAME_EMPTY,
+    NAME_NOT_UPPERCASE,
+    NAME_TOO_LONG,
+    NAME_TRAILING_SPACE,
+    NAME_NOT_ALPHABETIC,
+    NAME_DOUBLE_SPACE
+};
+
+/**
+ * @class NameDfa
+ * @brief Validates names with a deterministic finite automaton over raw bytes.
+ * 
+ * The automaton has the states start, in-word and after-space plus absorbing error states.
+ * Its transition table has one 256-entry row per state, so each byte costs a single table
+ * lookup and no data-dependent branch. Batches interleave several names up to the length
+ * of the shortest one, so the dependent lookups of different names overlap. Error states
+ * are mapped back to the messages of GameCharacter::validateName(), including its ordering
+ * of checks.
+ */
+class NameDfa {
+public:
+    /**
+     * @brief Validates one name.
+     * @param name The name to check.
+     * @return The outcome code.
+     */
+    static NameCheck check(const string &name) {
+        const unsigned char *bytes = (const unsigned char *)name.data();
+        size_t length = name.size();
+        uint8_t state = START;
+        size_t accepted = 0;
+        for (size_t i = 0; i < length; ++i) {
+            state = table.next[state][bytes[i]];
+            accepted += state < ERROR_BASE;
+        }
+        return finish(name, state, accepted);
+    }
+
+    /**
+     * @brief Validates many names, interleaving DFA_LANES names at a time.
+     * @param names The names to check.
+     * @param count The number of names.
+     * @param results Receives the outcome code of each name.
+     */
+    static void checkBatch(const string *names, size_t count, NameCheck *results) {
+        size_t first = 0;
+        for (; first + DFA_LANES <= count; first += DFA_LANES) {
+            const unsigned char *bytes[DFA_LANES];
+            size_t accepted[DFA_LANES];
+            uint8_t states[DFA_LANES];
+            size_t shortest = names[first].size();
+            for (int lane = 0; lane < DFA_LANES; ++lane) {
+                bytes[lane] = (const unsigned char *)names[first + lane].data();
+                shortest = min(shortest, names[first + lane].size());
+                states[lane] = START;
+                accepted[lane] = 0;
+            }
+            for (size_t i = 0; i < shortest; ++i) {
+                for (int lane = 0; lane < DFA_LANES; ++lane) {
+                    states[lane] = table.next[states[lane]][bytes[lane][i]];
+                    accepted[lane] += states[lane] < ERROR_BASE;
+                }
+            }
+            for (int lane = 0; lane < DFA_LANES; ++lane) {
+                uint8_t state = states[lane];
+                size_t length = names[first + lane].size();
+                for (size_t i = shortest; i < length; ++i) {
+                    state = table.next[state][bytes[lane][i]];
+                    accepted[lane] += state < ERROR_BASE;
+                }
+                results[first + lane] = finish(names[first + lane], state, accepted[lane]);
+            }
+        }
+        for (; first < count; ++first) {
+            results[first] = check(names[first]);
+        }
+    }
+
+    /**
+     * @brief Gets the validation message of an outcome code.
+     * @param result The outcome code.
+     * @return The message GameCharacter::validateName() uses for the same error.
+     */
+    static string message(NameCheck result) {
+        switch (result) {
+            case NAME_EMPTY:
+                return "Character name cannot be empty.";
+            case NAME_NOT_UPPERCASE:
+                return "Name must start with an uppercase letter.";
+            case NAME_TOO_LONG:
+                return "Name length cannot exceed " + to_string(MAX_NAME) + " characters.";
+            case NAME_TRAILING_SPACE:
+                return "Invalid character name. Last character cannot be space.";
+            case NAME_NOT_ALPHABETIC:
+                return "Name must contain only alphabetic characters and spaces.";
+            case NAME_DOUBLE_SPACE:
+                return "Invalid character name. It should not contain spaces following another space.";
+            default:
+                return "";
+        }
+    }
+
+    /**
+     * @brief Validates a name.
+     * @param name The name to check.
+     * @throw std::invalid_argument With the message validateName() would use.
+     */
+    static void validate(const string &name) {
+        NameCheck result = check(name);
+        if (result != NAME_VALID) {
+            throw invalid_argument(message(result));
+        }
+    }
+
+private:
+    enum State : uint8_t {
+        START,
+        IN_WORD,
+        AFTER_SPACE,
+        ERROR_BASE,
+        ERROR_NOT_UPPERCASE = ERROR_BASE,
+        ERROR_NOT_ALPHABETIC,
+        ERROR_DOUBLE_SPACE,
+        STATE_COUNT
+    };
+
+    struct Table {
+        uint8_t next[STATE_COUNT][256];
+    };
+
+    static constexpr Table build() {
+        Table result{};
+        for (int state = 0; state < STATE_COUNT; ++state) {
+            for (int c = 0; c < 256; ++c) {
+                bool letter = UpperCase::contains(c) || LowerCase::contains(c);
+                bool space = c == ' ';
+                uint8_t next = state;
+                if (state == START) {
+                    next = UpperCase::contains(c) ? IN_WORD : ERROR_NOT_UPPERCASE;
+                } else if (state == IN_WORD) {
+                    next = letter ? IN_WORD : (space ? AFTER_SPACE : ERROR_NOT_ALPHABETIC);
+                } else if (state == AFTER_SPACE) {
+                    next = letter ? IN_WORD : ERROR_DOUBLE_SPACE;
+                }
+                result.next[state][c] = next;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Maps the final state of a name to an outcome code.
+     * @param name The checked name.
+     * @param state The final DFA state.
+     * @param accepted The number of bytes consumed before entering an error state.
+     * @return The outcome code.
+     */
+    static NameCheck finish(const string &name, uint8_t state, size_t accepted) {
+        size_t length = name.size();
+        if (length == 0) {
+            return NAME_EMPTY;
+        }
+        if (state == ERROR_NOT_UPPERCASE) {
+            return NAME_NOT_UPPERCASE;
+        }
+        if (length > MAX_NAME) {
+            return NAME_TOO_LONG;
+        }
+        if (state == AFTER_SPACE || (state >= ERROR_BASE && accepted == length - 1 && name[length - 1] == ' ')) {
+            return NAME_TRAILING_SPACE;
+        }
+        if (state == ERROR_NOT_ALPHABETIC) {
+            return NAME_NOT_ALPHABETIC;
+        }
+        if (state == ERROR_DOUBLE_SPACE) {
+            return NAME_DOUBLE_SPACE;
+        }
+        return NAME_VALID;
+    }
+
+    static const Table table;
+};
+
+constexpr NameDfa::Table NameDfa::table = NameDfa::build();
+
+#define CHARACTER_KERNELS_VARIABLE "CHARACTER_KERNELS"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHARACTER_KERNEL_TARGETS 1
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define SCALAR_KERNEL __attribute__((optimize("no-tree-vectorize")))
+#else
+#define SCALAR_KERNEL
+#endif
+
+/**
+ * @brief The data-parallel kernels of the character stores, compiled for one instruction set.
+ */
+struct CharacterKernels {
+    const char *name;
+    void (*checkNames)(const string *names, size_t count, NameCheck *results);
+    void (*applyDamage)(int *health, const int *damage, size_t count);
+    int64_t (*totalHealth)(const int *health, size_t count);
+    void (*packStats)(const int *health, const int *attackPower, size_t count, uint32_t *packed);
+};
+
+/**
+ * @brief Defines the numeric kernels once per instruction set variant.
+ * 
+ * applyDamage subtracts damage from health, leaving invincible characters (-1) alone and
+ * stopping at 0. totalHealth sums the health of characters that are alive and not
+ * invincible. packStats interleaves health and attack power into 32-bit words.
+ */
+#define CHARACTER_KERNELS(suffix, attributes) \
+    attributes void applyDamage##suffix(int *health, const int *damage, size_t count) { \
+        for (size_t i = 0; i < count; ++i) { \
+            int value = health[i] - damage[i]; \
+            health[i] = health[i] == -1 ? -1 : (value < 0 ? 0 : value); \
+        } \
+    } \
+    attributes int64_t totalHealth##suffix(const int *health, size_t count) { \
+        int64_t total = 0; \
+        for (size_t i = 0; i < count; ++i) { \
+            total += health[i] > 0 ? health[i] : 0; \
+        } \
+        return total; \
+    } \
+    attributes void packStats##suffix(const int *health, const int *attackPower, size_t count, uint32_t *packed) { \
+        for (size_t i = 0; i < count; ++i) { \
+            packed[2 * i] = (uint32_t)health[i]; \
+            packed[2 * i + 1] = (uint32_t)attackPower[i]; \
+        } \
+    }
+
+CHARACTER_KERNELS(Scalar, SCALAR_KERNEL)
+#ifdef CHARACTER_KERNEL_TARGETS
+CHARACTER_KERNELS(Sse42, __attribute__((target("sse4.2"))))
+CHARACTER_KERNELS(Avx2, __attribute__((target("avx2"))))
+#endif
+
+/**
+ * @brief Scalar reference for name validation, one name after another.
+ */
+inline void checkNamesScalar(const string *names, size_t count, NameCheck *results) {
+    for (size_t i = 0; i < count; ++i) {
+        results[i] = NameDfa::check(names[i]);
+    }
+}
+
+/**
+ * @brief Lists the kernel variants the running CPU supports, the scalar reference first.
+ * 
+ * Name validation is a chain of table lookups that no instruction set widens, so the vector
+ * variants bind the interleaved DFA instead of a wider version of it.
+ * 
+ * @return The supported variants, from the most portable to the fastest.
+ */
+inline vector<const CharacterKernels *> supportedKernels() {
+    static const CharacterKernels scalar = {"scalar", checkNamesScalar, applyDamageScalar, totalHealthScalar, packStatsScalar};
+    vector<const CharacterKernels *> variants = {&scalar};
+#ifdef CHARACTER_KERNEL_TARGETS
+    static const CharacterKernels sse42 = {"sse4.2", NameDfa::checkBatch, applyDamageSse42, totalHealthSse42, packStatsSse42};
+    static const CharacterKernels avx2 = {"avx2", NameDfa::checkBatch, applyDamageAvx2, totalHealthAvx2, packStatsAvx2};
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        variants.push_back(&sse42);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        variants.push_back(&avx2);
+    }
+#endif
+    return variants;
+}
+
+/**
+ * @brief Chooses a kernel variant.
+ * @param requested The name of the variant to use, or null or empty for the fastest supported one.
+ * @return The chosen variant.
+ * @throw std::invalid_argument If the requested variant is unknown or not supported by the CPU.
+ */
+inline const CharacterKernels &selectKernels(const char *requested) {
+    vector<const CharacterKernels *> variants = supportedKernels();
+    if (requested == nullptr || *requested == 0) {
+        return *variants.back();
+    }
+    for (const CharacterKernels *variant : variants) {
+        if (strcmp(variant->name, requested) == 0) {
+            return *variant;
+        }
+    }
+    throw invalid_argument("Kernel variant " + string(requested) + " is not supported on this CPU.");
+}
+
+/**
+ * @brief Chooses the variant to bind for a requested name, falling back to the fastest one.
+ * @param requested The name of the variant to use, or null or empty for the fastest supported one.
+ * @return The requested variant, or the fastest supported one if the name is unknown or unsupported.
+ */
+inline const CharacterKernels &bindKernels(const char *requested) {
+    try {
+        return selectKernels(requested);
+    } catch (invalid_argument &) {
+        return selectKernels(nullptr);
+    }
+}
+
+/**
+ * @brief Gets the kernels bound for this process.
+ * 
+ * The variant is chosen once, on first use, from the CPU features; the CHARACTER_KERNELS
+ * environment variable forces a variant by name, e.g. scalar. An unknown or unsupported
+ * name falls back to the fastest supported variant.
+ * 
+ * @return The bound kernels.
+ */
+inline const CharacterKernels &characterKernels() {
+    static const CharacterKernels &bound = bindKernels(getenv(CHARACTER_KERNELS_VARIABLE));
+    return bound;
+}
+
+/**
+ * @brief Runs a function over consecutive chunks of the range [0, count) on several threads.
+ * 
+ * Chunks are handed out dynamically, so a slow chunk does not stall the other workers.
+ * When there is only one chunk or one worker, everything runs on the calling thread.
+ * 
+ * @param count The number of elements to process.
+ * @param chunkSize The number of elements in one chunk.
+ * @param function Called as function(chunkIndex, begin, end) once for every chunk.
+ * @param workers The number of threads to use, or 0 to use the hardware concurrency.
+ */
+template <class Function>
+void parallelForChunks(size_t count, size_t chunkSize, Function function, unsigned workers = 0) {
+    size_t chunks = (count + chunkSize - 1) / chunkSize;
+    if (workers == 0) {
+        workers = max(1u, thread::hardware_concurrency());
+    }
+    if (workers > chunks) {
+        workers = (unsigned)chunks;
+    }
+    if (workers <= 1) {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            function(chunk, chunk * chunkSize, min(count, (chunk + 1) * chunkSize));
+        }
+        return;
+    }
+    atomic<size_t> next(0);
+    auto run = [&]() {
+        for (size_t chunk = next++; chunk < chunks; chunk = next++) {
+            function(chunk, chunk * chunkSize, min(count, (chunk + 1) * chunkSize));
+        }
+    };
+    vector<thread> threads;
+    for (unsigned i = 1; i < workers; ++i) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (thread &worker : threads) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Raw column pointers handed to query expressions while they are evaluated.
+ */
+struct CharacterColumns {
+    const string *names;
+    const int *health;
+    const int *attackPower;
+    const CharacterId *ids;
+    const uint64_t *nameRefs;
+    const char *nameBase;
+
+    /**
+     * @brief Gets the name of a row, also while it is still a reference into a restored snapshot.
+     * @param row The row.
+     * @return The name bytes, not validated yet for unmaterialized names.
+     */
+    string_view name(size_t row) const {
+        uint64_t ref = nameRefs[row];
+        return ref == 0 ? string_view(names[row]) : string_view(nameBase + (ref >> 8), ref & 0x7f);
+    }
+};
+
+/**
+ * @namespace query
+ * @brief Expression templates for predicates over the columns of a CharacterStore.
+ * 
+ * Expressions such as `query::health < 100 && query::attackPower > 50` are built at compile
+ * time and evaluated row by row inside one loop over the columns. Logical operators are
+ * evaluated without short-circuiting, so numeric predicates compile to branch-free code
+ * that the compiler can vectorize.
+ */
+namespace query {
+
+    /**
+     * @brief Base of all query expressions (CRTP), used to recognize expression operands.
+     */
+    template <class Derived>
+    struct Expression {
+        const Derived &self() const {
+            return static_cast<const Derived &>(*this);
+        }
+    };
+
+    enum Field { HEALTH, ATTACK_POWER, ID };
+
+    /**
+     * @brief Reads one numeric column of the current row.
+     */
+    template <Field F>
+    struct Column : Expression<Column<F>> {
+        auto eval(const CharacterColumns &columns, size_t row) const {
+            if constexpr (F == HEALTH) {
+                return columns.health[row];
+            } else if constexpr (F == ATTACK_POWER) {
+                return columns.attackPower[row];
+            } else {
+                return columns.ids[row];
+            }
+        }
+    };
+
+    /**
+     * @brief An integer literal inside an expression.
+     */
+    template <class T>
+    struct Literal : Expression<Literal<T>> {
+        T value;
+
+        Literal(T value) : value(value) {}
+
+        T eval(const CharacterColumns &, size_t) const {
+            return value;
+        }
+    };
+
+    typedef Literal<int> Constant;
+
+    /**
+     * @brief Matches rows whose name starts with the given prefix.
+     */
+    struct NamePrefix : Expression<NamePrefix> {
+        string prefix;
+
+        NamePrefix(string prefix) : prefix(prefix) {}
+
+        int eval(const CharacterColumns &columns, size_t row) const {
+            return columns.name(row).compare(0, prefix.size(), prefix) == 0;
+        }
+    };
+
+    /**
+     * @brief Applies a binary operation to the values of two subexpressions.
+     */
+    template <class Operation, class Left, class Right>
+    struct Binary : Expression<Binary<Operation, Left, Right>> {
+        Left left;
+        Right right;
+
+        Binary(const Left &left, const Right &right) : left(left), right(right) {}
+
+        auto eval(const CharacterColumns &columns, size_t row) const {
+            return Operation::apply(left.eval(columns, row), right.eval(columns, row));
+        }
+    };
+
+    /**
+     * @brief Logical negation of a subexpression.
+     */
+    template <class Operand>
+    struct Not : Expression<Not<Operand>> {
+        Operand operand;
+
+        Not(const Operand &operand) : operand(operand) {}
+
+        int eval(const CharacterColumns &columns, size_t row) const {
+            return !operand.eval(columns, row);
+        }
+    };
+
+#define QUERY_OPERATION(Name, Result, expression) \
+    struct Name { \
+        template <class A, class B> \
+        static Result apply(A a, B b) { \
+            return expression; \
+        } \
+    };
+
+    QUERY_OPERATION(Less, int, a < b)
+    QUERY_OPERATION(LessEqual, int, a <= b)
+    QUERY_OPERATION(Greater, int, a > b)
+    QUERY_OPERATION(GreaterEqual, int, a >= b)
+    QUERY_OPERATION(Equal, int, a == b)
+    QUERY_OPERATION(NotEqual, int, a != b)
+    QUERY_OPERATION(And, int, (a != 0) & (b != 0))
+    QUERY_OPERATION(Or, int, (a != 0) | (b != 0))
+    QUERY_OPERATION(Plus, auto, a + b)
+    QUERY_OPERATION(Minus, auto, a - b)
+    QUERY_OPERATION(Multiply, auto, a * b)
+    QUERY_OPERATION(Modulo, auto, a % b)
+    QUERY_OPERATION(Minimum, auto, a < b ? a : b)
+    QUERY_OPERATION(Maximum, auto, a > b ? a : b)
+
+    template <class T>
+    struct IsExpression : is_base_of<Expression<T>, T> {};
+
+    template <class T, class = typename enable_if<is_integral<T>::value>::type>
+    Literal<T> asExpression(T value) {
+        return Literal<T>(value);
+    }
+
+    template <class Derived>
+    const Derived &asExpression(const Expression<Derived> &expression) {
+        return expression.self();
+    }
+
+    template <class T>
+    using ExpressionType = typename decay<decltype(asExpression(declval<const T &>()))>::type;
+
+    template <class L, class R>
+    using EnableIfExpression = typename enable_if<IsExpression<L>::value || IsExpression<R>::value>::type;
+
+#define QUERY_BINARY_OPERATOR(symbol, Operation) \
+    template <class L, class R, class = EnableIfExpression<L, R>> \
+    Binary<Operation, ExpressionType<L>, ExpressionType<R>> operator symbol(const L &left, const R &right) { \
+        return Binary<Operation, ExpressionType<L>, ExpressionType<R>>(asExpression(left), asExpression(right)); \
+    }
+
+    QUERY_BINARY_OPERATOR(<, Less)
+    QUERY_BINARY_OPERATOR(<=, LessEqual)
+    QUERY_BINARY_OPERATOR(>, Greater)
+    QUERY_BINARY_OPERATOR(>=, GreaterEqual)
+    QUERY_BINARY_OPERATOR(==, Equal)
+    QUERY_BINARY_OPERATOR(!=, NotEqual)
+    QUERY_BINARY_OPERATOR(&&, And)
+    QUERY_BINARY_OPERATOR(||, Or)
+    QUERY_BINARY_OPERATOR(+, Plus)
+    QUERY_BINARY_OPERATOR(-, Minus)
+    QUERY_BINARY_OPERATOR(*, Multiply)
+    QUERY_BINARY_OPERATOR(%, Modulo)
+
+    template <class Operand>
+    Not<Operand> operator!(const Expression<Operand> &operand) {
+        return Not<Operand>(operand.self());
+    }
+
+    /**
+     * @brief The smaller of two expression values, e.g. `query::min(query::health + 10, MAX_HEALTH)`.
+     */
+    template <class L, class R, class = EnableIfExpression<L, R>>
+    Binary<Minimum, ExpressionType<L>, ExpressionType<R>> min(const L &left, const R &right) {
+        return Binary<Minimum, ExpressionType<L>, ExpressionType<R>>(asExpression(left), asExpression(right));
+    }
+
+    /**
+     * @brief The larger of two expression values.
+     */
+    template <class L, class R, class = EnableIfExpression<L, R>>
+    Binary<Maximum, ExpressionType<L>, ExpressionType<R>> max(const L &left, const R &right) {
+        return Binary<Maximum, ExpressionType<L>, ExpressionType<R>>(asExpression(left), asExpression(right));
+    }
+
+    const Column<HEALTH> health;
+    const Column<ATTACK_POWER> attackPower;
+    const Column<ID> id;
+    const Binary<Equal, Column<HEALTH>, Constant> invincible(health, Constant(-1));
+
+    /**
+     * @brief Builds a predicate matching names that start with the given prefix.
+     * @param prefix The required beginning of the name.
+     * @return The predicate expression.
+     */
+    inline NamePrefix nameStartsWith(string prefix) {
+        return NamePrefix(prefix);
+    }
+}
+
+#define QUERY_CHUNK 16384
+#define PREFETCH_DISTANCE 16
+
+/**
+ * @brief Reads health and attack power of characters addressed through an index list.
+ * 
+ * Target lists point at characters scattered in memory, so every access would otherwise miss
+ * the cache twice: once for the pointer and once for the object. The pointer slot is
+ * prefetched 2 * distance entries ahead and the object itself distance entries ahead, so the
+ * loads overlap instead of being serialized.
+ * 
+ * @param characters The character pointers the indices refer to.
+ * @param indices The indices of the characters to read.
+ * @param count The number of indices.
+ * @param health Receives the health of each addressed character.
+ * @param attackPower Receives the attack power of each addressed character.
+ * @param distance How many entries ahead to prefetch, or 0 to disable prefetching.
+ */
+void gatherCharacters(GameCharacter *const *characters, const uint32_t *indices, size_t count,
+                      int *health, int *attackPower, size_t distance = PREFETCH_DISTANCE) {
+    for (size_t i = 0; i < count; ++i) {
+        if (distance != 0) {
+            if (i + 2 * distance < count) {
+                __builtin_prefetch(&characters[indices[i + 2 * distance]]);
+            }
+            if (i + distance < count) {
+                __builtin_prefetch(characters[indices[i + distance]]);
+            }
+        }
+        const GameCharacter *character = characters[indices[i]];
+        health[i] = character->health;
+        attackPower[i] = character->attackPower;
+    }
+}
+
+/**
+ * @brief What a bulk update does with values that fail character validation.
+ */
+enum UpdatePolicy {
+    CLAMP_VALUES,   ///< Clamp health into [0 (dead), MAX_HEALTH] and attack power to MAX_POWER.
+    REJECT_INVALID  ///< Throw std::invalid_argument and leave the store unchanged.
+};
+
+#define DESPAWN_PARALLEL_ROWS 65536
+#define STORE_CHANGE_CHUNK 4096
+
+static_assert(QUERY_CHUNK % STORE_CHANGE_CHUNK == 0, "Parallel updates must own whole change chunks.");
+#define MIGRATION_MAGIC 0x474d4843u
+#define MIGRATION_VERSION 2
+
+/**
+ * @brief Computes the 64-bit FNV-1a hash of a byte range.
+ * @param data The bytes to hash.
+ * @param length The number of bytes.
+ * @param hash The starting value, to continue a previous hash.
+ * @return The hash value.
+ */
+inline uint64_t fnv1a64(const uint8_t *data, size_t length, uint64_t hash = 14695981039346656037ULL) {
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Appends an unsigned integer in little-endian byte order.
+ * @param buffer The buffer to append to.
+ * @param value The value to append.
+ * @param bytes The number of bytes to write.
+ */
+inline void putLittleEndian(vector<uint8_t> &buffer, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        buffer.push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+/**
+ * @brief Reads an unsigned little-endian integer.
+ * @param data The first byte of the integer.
+ * @param bytes The number of bytes to read.
+ * @return The value.
+ */
+inline uint64_t getLittleEndian(const uint8_t *data, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value |= (uint64_t)data[i] << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * @brief How IDs of migrated characters are assigned on the receiving side.
+ */
+enum IdRemapPolicy {
+    KEEP_IDS,  ///< Keep the original ID unless it may be live in this world, then assign a new one.
+    REMAP_IDS,  ///< Always assign a new ID from the store's counters.
+    RESTORE_IDS ///< Keep the original ID unless this store already uses it; for a world's own snapshots.
+};
+
+/**
+ * @brief A stable reference to a character in a CharacterStore.
+ * 
+ * Rows move when characters are removed, so long-lived references go through a slot table.
+ * The generation detects handles whose character has been despawned in the meantime.
+ */
+struct CharacterHandle {
+    uint32_t slot;
+    uint32_t generation;
+
+    bool operator==(const CharacterHandle &other) const {
+        return slot == other.slot && generation == other.generation;
+    }
+};
+
+/**
+ * @brief How many restored names have been materialized.
+ */
+struct NameMetrics {
+    size_t restored;  ///< Characters restored from snapshots.
+    size_t touched;   ///< Names read or replaced since.
+};
+
+class ColumnarFile;
+
+/**
+ * @class CharacterStore
+ * @brief Stores many characters column by column (structure of arrays) for bulk processing.
+ * 
+ * Every row is a character validated by the same rules as GameCharacter, except that health
+ * 0 is the store's dead state: damage(), set() and bulk updates may leave a row at 0, and it
+ * stays there until it is despawned, e.g. by the cleanup of a SimulationLoop. Rows take
+ * their IDs from, and are counted in, the counters of the store's world (by default those
+ * of GameCharacter), so a store and individual GameCharacter objects share one ID space.
+ * Rows are kept dense; handles and the ID registry stay valid when rows move. Rows restored
+ * from a columnar snapshot keep their names as references into it until getName() or
+ * rename() materializes them; until then their entry in names is empty. Every row is part
+ * of the world checksum; the store's mutators keep it up to date, with a cached hash of
+ * every name, while direct writes to the public columns are caught by recomputeChecksum().
+ */
+class CharacterStore {
+public:
+    vector<string> names;
+    vector<int> health;
+    vector<int> attackPower;
+    vector<CharacterId> ids;
+
+    /**
+     * @brief Handle slot of every row.
+     */
+    vector<uint32_t> rowSlots;
+
+    /**
+     * @brief Number of threads used by bulk operations, or 0 for the hardware concurrency.
+     */
+    unsigned workers = 0;
+
+    /**
+     * @brief Constructor to create an empty store.
+     * @param counters The counters of the world the store belongs to.
+     */
+    CharacterStore(CharacterCounters &counters = GameCharacter::defaultCounters) : counters(&counters) {}
+
+    CharacterStore(const CharacterStore &) = delete;
+    CharacterStore &operator=(const CharacterStore &) = delete;
+
+    /**
+     * @brief Destructor to remove all stored characters from the object count.
+     */
+    ~CharacterStore() {
+        counters->objectCount -= (int)size();
+        for (size_t row = 0; row < size(); ++row) {
+            counters->checksum -= rowHash(row);
+        }
+    }
+
+    /**
+     * @brief Adds a new character to the store.
+     * 
+     * @param name The name of the character.
+     * @param health The health points of the character (positive value or -1 for invincible).
+     * @param attackPower The attack power of the character.
+     * @return The handle of the new character.
+     * @throw std::invalid_argument If name, health, or attack power is invalid.
+     */
+    CharacterHandle add(string name, int health, int attackPower) {
+        GameCharacter::validate(name, health, attackPower);
+        ++counters->objectCount;
+        return append(name, health, attackPower, counters->mintId());
+    }
+
+    /**
+     * @brief Adds a new character with an ID minted beforehand, e.g. by an IdMinter of the store's world.
+     * 
+     * @param name The name of the character.
+     * @param health The health points of the character (positive value or -1 for invincible).
+     * @param attackPower The attack power of the character.
+     * @param id The unique ID of the character.
+     * @return The handle of the new character.
+     * @throw std::invalid_argument If an attribute is invalid or the ID is already stored.
+     */
+    CharacterHandle add(string name, int health, int attackPower, CharacterId id) {
+        GameCharacter::validate(name, health, attackPower);
+        if (idSlots.count(id) != 0) {
+            throw invalid_argument("Character ID " + to_string(id) + " is already stored.");
+        }
+        ++counters->objectCount;
+        return append(name, health, attackPower, id);
+    }
+
+    /**
+     * @brief Reserves room for a number of characters, so that adding them does not reallocate.
+     * @param rows The total number of characters to make room for.
+     */
+    void reserve(size_t rows) {
+        names.reserve(rows);
+        health.reserve(rows);
+        attackPower.reserve(rows);
+        ids.reserve(rows);
+        rowSlots.reserve(rows);
+        nameHashes.reserve(rows);
+        nameRefs.reserve(rows);
+        slotRows.reserve(rows);
+        slotGenerations.reserve(rows);
+        idSlots.reserve(rows);
+    }
+
+    /**
+     * @brief Serializes characters into a compact binary migration buffer.
+     * 
+     * The buffer starts with a magic number, a version and the record count. Each record holds
+     * the 64-bit ID and the 32-bit health and attack power as little-endian integers,
+     * followed by the name length and bytes. An FNV-1a checksum of everything before it
+     * closes the buffer, so the receiver can trust the records without validating them again.
+     * Names still referring to a snapshot are validated and checked against their hash first.
+     * 
+     * @param rows The rows to serialize.
+     * @return The migration buffer.
+     * @throw std::invalid_argument If a restored name is invalid or does not match its hash.
+     */
+    vector<uint8_t> packMigration(const vector<uint32_t> &rows) const {
+        vector<uint8_t> buffer;
+        buffer.reserve(9 + rows.size() * (17 + 16) + 8);
+        putLittleEndian(buffer, MIGRATION_MAGIC, 4);
+        putLittleEndian(buffer, MIGRATION_VERSION, 1);
+        putLittleEndian(buffer, rows.size(), 4);
+        for (uint32_t row : rows) {
+            putLittleEndian(buffer, (uint64_t)ids[row], 8);
+            putLittleEndian(buffer, (uint32_t)health[row], 4);
+            putLittleEndian(buffer, (uint32_t)attackPower[row], 4);
+            string restored = nameRefs[row] != 0 ? restoredName(row) : string();
+            string_view name = nameRefs[row] != 0 ? string_view(restored) : string_view(names[row]);
+            putLittleEndian(buffer, name.size(), 1);
+            buffer.insert(buffer.end(), name.begin(), name.end());
+        }
+        putLittleEndian(buffer, fnv1a64(buffer.data(), buffer.size()), 8);
+        return buffer;
+    }
+
+    /**
+     * @brief Installs the characters of a migration buffer without validating them again.
+     * 
+     * With KEEP_IDS an original ID is kept unless this store already has a character with that
+     * ID or the ID may be live elsewhere in this world, i.e. it comes from this node and epoch
+     * and lies below the world's ID counters. The counters are moved past every kept ID so
+     * that later characters cannot collide with it. With REMAP_IDS every character gets a new ID.
+     * RESTORE_IDS only checks this store, for snapshots of the same world taken earlier.
+     * Every record is bounds-checked before the first one is installed, and the records must
+     * end exactly at the checksum, so a rejected buffer leaves the store unchanged.
+     * 
+     * @param buffer A buffer produced by packMigration().
+     * @param policy How IDs are assigned.
+     * @return The handles of the installed characters, in buffer order.
+     * @throw std::invalid_argument If the buffer is truncated, of another format, or corrupt.
+     */
+    vector<CharacterHandle> installMigration(const vector<uint8_t> &buffer, IdRemapPolicy policy) {
+        if (buffer.size() < 17 || getLittleEndian(buffer.data(), 4) != MIGRATION_MAGIC
+            || buffer[4] != MIGRATION_VERSION) {
+            throw invalid_argument("Not a character migration buffer.");
+        }
+        size_t end = buffer.size() - 8;
+        if (fnv1a64(buffer.data(), end) != getLittleEndian(buffer.data() + end, 8)) {
+            throw invalid_argument("Migration buffer checksum mismatch.");
+        }
+        size_t count = getLittleEndian(buffer.data() + 5, 4);
+        if (count > (end - 9) / 17) {
+            throw invalid_argument("Migration buffer is truncated.");
+        }
+        size_t offset = 9;
+        for (size_t i = 0; i < count; ++i) {
+            if (offset + 17 > end || offset + 17 + buffer[offset + 16] > end) {
+                throw invalid_argument("Migration buffer is truncated.");
+            }
+            offset += 17 + buffer[offset + 16];
+        }
+        if (offset != end) {
+            throw invalid_argument("Migration buffer has trailing bytes.");
+        }
+        vector<CharacterHandle> installed;
+        installed.reserve(count);
+        offset = 9;
+        for (size_t i = 0; i < count; ++i) {
+            CharacterId id = (CharacterId)getLittleEndian(buffer.data() + offset, 8);
+            int characterHealth = (int)getLittleEndian(buffer.data() + offset + 8, 4);
+            int characterAttackPower = (int)getLittleEndian(buffer.data() + offset + 12, 4);
+            size_t nameLength = buffer[offset + 16];
+            string name((const char *)buffer.data() + offset + 17, nameLength);
+            offset += 17 + nameLength;
+
+            if (policy == REMAP_IDS || idSlots.count(id) != 0 || (policy == KEEP_IDS && counters->mayBeLive(id))) {
+                id = counters->mintId();
+            } else {
+                counters->reserve(id);
+            }
+            ++counters->objectCount;
+            installed.push_back(append(name, characterHealth, characterAttackPower, id));
+        }
+        return installed;
+    }
+
+private:
+    /**
+     * @brief Appends an already validated and counted character with the given ID.
+     * 
+     * @param name The name of the character.
+     * @param health The health points of the character.
+     * @param attackPower The attack power of the character.
+     * @param id The unique ID of the character.
+     * @param nameRef The reference to a name in the snapshot at nameBase, or 0 to use name.
+     * @param nameHash The characterNameHash() of the referenced name; ignored without nameRef.
+     * @param registered The ID registry entry if the caller has already made one.
+     * @return The handle of the new character.
+     */
+    CharacterHandle append(string name, int health, int attackPower, CharacterId id, uint64_t nameRef = 0,
+                           uint64_t nameHash = 0, uint32_t *registered = nullptr) {
+        uint32_t slot;
+        if (freeSlots.empty()) {
+            slot = (uint32_t)slotRows.size();
+            slotRows.push_back(0);
+            slotGenerations.push_back(0);
+        } else {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        slotRows[slot] = (uint32_t)size();
+        names.push_back(name);
+        nameRefs.push_back(nameRef);
+        nameHashes.push_back(nameRef != 0 ? nameHash : characterNameHash(name.data(), name.size()));
+        this->health.push_back(health);
+        this->attackPower.push_back(attackPower);
+        ids.push_back(id);
+        rowSlots.push_back(slot);
+        if (registered != nullptr) {
+            *registered = slot;
+        } else {
+            idSlots[id] = slot;
+        }
+        counters->checksum += rowHash(size() - 1);
+        if ((size() - 1) / STORE_CHANGE_CHUNK == chunkChanges.size()) {
+            chunkChanges.push_back(0);
+        }
+        markChanged(size() - 1);
+        if (counters->journal != nullptr) {
+            counters->journal->spawn(id, string(columns().name(size() - 1)), health, attackPower);
+        }
+        return CharacterHandle{slot, slotGenerations[slot]};
+    }
+
+public:
+
+    /**
+     * @brief Renames a character.
+     * 
+     * @param handle The handle of the character.
+     * @param name The new name.
+     * @throw std::invalid_argument If the name is invalid or the character has been despawned.
+     */
+    void rename(CharacterHandle handle, const string &name) {
+        size_t row = rowOf(handle);
+        GameCharacter::validate(name, 1, 0);
+        counters->checksum -= rowHash(row);
+        names[row] = name;
+        touchName(row);
+        nameHashes[row] = characterNameHash(name.data(), name.size());
+        counters->checksum += rowHash(row);
+        markChanged(row);
+        if (counters->journal != nullptr) {
+            counters->journal->rename(ids[row], name);
+        }
+    }
+
+    /**
+     * @brief Deals damage to a character.
+     * 
+     * Invincible characters are not affected, and health does not drop below 0.
+     * 
+     * @param handle The handle of the character.
+     * @param amount The damage, not negative.
+     * @throw std::invalid_argument If the amount is negative or the character is despawned.
+     */
+    void damage(CharacterHandle handle, int amount) {
+        if (amount < 0) {
+            throw invalid_argument("Damage must not be negative.");
+        }
+        size_t row = rowOf(handle);
+        if (health[row] != -1) {
+            counters->checksum -= rowHash(row);
+            health[row] = max(0, health[row] - amount);
+            counters->checksum += rowHash(row);
+            markChanged(row);
+        }
+        if (counters->journal != nullptr) {
+            counters->journal->damage(ids[row], amount);
+        }
+    }
+
+    /**
+     * @brief Deals damage to many characters at once through the bound damage kernel.
+     * 
+     * The health of all targets is gathered, updated by one characterKernels().applyDamage()
+     * call and scattered back; invincible characters are not affected, and health does not
+     * drop below 0. Every target is journaled like a single damage().
+     * 
+     * @param targets The handles of the characters, each at most once.
+     * @param amounts The damage of each target, not negative.
+     * @throw std::invalid_argument If the sizes differ, an amount is negative or a character
+     *                              is despawned; then nothing is changed.
+     */
+    void damage(const vector<CharacterHandle> &targets, const vector<int> &amounts) {
+        if (targets.size() != amounts.size()) {
+            throw invalid_argument("Every damage target needs one amount.");
+        }
+        vector<uint32_t> rows(targets.size());
+        vector<int> newHealth(targets.size());
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (amounts[i] < 0) {
+                throw invalid_argument("Damage must not be negative.");
+            }
+            rows[i] = (uint32_t)rowOf(targets[i]);
+            newHealth[i] = health[rows[i]];
+        }
+        characterKernels().applyDamage(newHealth.data(), amounts.data(), rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (newHealth[i] != health[rows[i]]) {
+                counters->checksum -= rowHash(rows[i]);
+                health[rows[i]] = newHealth[i];
+                counters->checksum += rowHash(rows[i]);
+                markChanged(rows[i]);
+            }
+            if (counters->journal != nullptr) {
+                counters->journal->damage(ids[rows[i]], amounts[i]);
+            }
+        }
+    }
+
+    /**
+     * @brief Recomputes the share of the store in the world checksum from the columns.
+     * @return The sum of characterHash() over all rows, modulo 2^64.
+     */
+    uint64_t recomputeChecksum() const {
+        uint64_t sum = 0;
+        CharacterColumns rows = columns();
+        for (size_t row = 0; row < size(); ++row) {
+            string_view name = rows.name(row);
+            sum += mixCharacterHash(characterNameHash(name.data(), name.size()), ids[row], health[row], attackPower[row]);
+        }
+        return sum;
+    }
+
+    /**
+     * @brief Checks whether a handle still refers to a character in the store.
+     * @param handle The handle to check.
+     * @return True if the character has not been despawned.
+     */
+    bool contains(CharacterHandle handle) const {
+        return handle.slot < slotGenerations.size() && slotGenerations[handle.slot] == handle.generation;
+    }
+
+    /**
+     * @brief Gets the current row of a character.
+     * @param handle The handle of the character.
+     * @return The row index.
+     * @throw std::invalid_argument If the character has been despawned.
+     */
+    size_t rowOf(CharacterHandle handle) const {
+        if (!contains(handle)) {
+            throw invalid_argument("Character handle refers to a despawned character.");
+        }
+        return slotRows[handle.slot];
+    }
+
+    /**
+     * @brief Gets the handle of the character in a row.
+     * @param row The row index, less than size().
+     * @return The handle of the character.
+     */
+    CharacterHandle handleAt(size_t row) const {
+        uint32_t slot = rowSlots[row];
+        return CharacterHandle{slot, slotGenerations[slot]};
+    }
+
+    /**
+     * @brief Looks up a character by its unique ID.
+     * @param id The unique ID of the character.
+     * @return The handle of the character.
+     * @throw std::invalid_argument If no character with this ID is stored.
+     */
+    CharacterHandle find(CharacterId id) const {
+        auto found = idSlots.find(id);
+        if (found == idSlots.end()) {
+            throw invalid_argument("No character with ID " + to_string(id) + ".");
+        }
+        return CharacterHandle{found->second, slotGenerations[found->second]};
+    }
+
+    /**
+     * @brief Gets the number of changes made through the store's mutators so far.
+     * 
+     * Together with getChunkChanges() it lets copies of the store, e.g. VersionedColumns
+     * and SnapshotPublisher, refresh only what changed since they last looked. Writes to the
+     * public columns are not counted.
+     * 
+     * @return The change counter.
+     */
+    uint64_t getChangeCount() const {
+        return changes;
+    }
+
+    /**
+     * @brief Gets the change counter at the last change of every chunk of STORE_CHANGE_CHUNK rows.
+     * 
+     * A chunk is dirty for a copy that was refreshed at change count c if its entry is greater
+     * than c. Chunks past the end of the store may have entries; their rows were despawned.
+     * 
+     * @return One entry per chunk that ever held rows.
+     */
+    const vector<uint64_t> &getChunkChanges() const {
+        return chunkChanges;
+    }
+
+    /**
+     * @brief Gets the name of a character, materializing it on first use after a restore.
+     * 
+     * @param handle The handle of the character.
+     * @return The name.
+     * @throw std::invalid_argument If the character has been despawned or its restored name is
+     *                              invalid or does not match its hash.
+     */
+    const string &getName(CharacterHandle handle) {
+        size_t row = rowOf(handle);
+        if (nameRefs[row] != 0) {
+            names[row] = restoredName(row);
+            touchName(row);
+        }
+        return names[row];
+    }
+
+    /**
+     * @brief Gets the characterNameHash() of every row's name, kept for the world checksum.
+     * @return One hash per row.
+     */
+    const vector<uint64_t> &getNameHashes() const {
+        return nameHashes;
+    }
+
+    /**
+     * @brief Adds every character of a columnar snapshot with lazily materialized names.
+     * 
+     * Only the numeric columns are copied; the name hashes of the snapshot go into the world
+     * checksum, so no name is read. Every name is kept as an 8-byte reference into the
+     * snapshot, which, e.g. a MappedFile, must stay mapped for as long as untouched names may
+     * be read; getName() validates it, checks it against its hash and materializes it, and
+     * rename() replaces it without reading it. IDs are kept, and the world's ID counter is
+     * moved past them. Names still referring to an earlier snapshot are materialized first.
+     * 
+     * @param file The snapshot.
+     * @return The handles of the restored characters, in snapshot order.
+     * @throw std::invalid_argument If an ID is already stored or appears twice, in which case
+     *                              nothing is restored, or if an earlier restored name is invalid.
+     */
+    vector<CharacterHandle> restoreColumnar(const ColumnarFile &file);
+
+    /**
+     * @brief Gets how many restored names have been materialized so far.
+     * @return The metrics.
+     */
+    NameMetrics getNameMetrics() const {
+        return nameMetrics;
+    }
+
+    /**
+     * @brief Checks whether a character with an ID is stored.
+     * @param id The unique ID of the character.
+     * @return True if find() would succeed.
+     */
+    bool has(CharacterId id) const {
+        return idSlots.count(id) != 0;
+    }
+
+    /**
+     * @brief Sets health and attack power of a character, e.g. when a replay is played back.
+     * 
+     * @param handle The handle of the character.
+     * @param health The new health, -1 for invincible or 0 (dead) to MAX_HEALTH.
+     * @param attackPower The new attack power, at most MAX_POWER.
+     * @throw std::invalid_argument If a value is out of range or the character has been despawned.
+     */
+    void set(CharacterHandle handle, int health, int attackPower) {
+        size_t row = rowOf(handle);
+        if (health < -1 || health > MAX_HEALTH || attackPower > MAX_POWER) {
+            throw invalid_argument("Character attributes out of range.");
+        }
+        counters->checksum -= rowHash(row);
+        this->health[row] = health;
+        this->attackPower[row] = attackPower;
+        counters->checksum += rowHash(row);
+        markChanged(row);
+        if (counters->journal != nullptr) {
+            counters->journal->set(ids[row], health, attackPower);
+        }
+    }
+
+    /**
+     * @brief Removes every character whose bit is set in a death bitmap.
+     * 
+     * Handles and ID registry entries of the dead are released in one sweep and the object
+     * count is decreased once by the batch size. Small batches fill each hole with a live row
+     * from the end (swap-remove), touching only as many rows as died. Batches of at least
+     * DESPAWN_PARALLEL_ROWS characters are compacted in parallel into fresh columns instead,
+     * which keeps the surviving rows in order. Either way the columns stay dense.
+     * 
+     * @param deathBitmap One bit per row, as produced by filter(); bit i of word i / 64 marks row i.
+     * @return The number of despawned characters.
+     */
+    size_t despawn(const vector<uint64_t> &deathBitmap) {
+        size_t count = size();
+        auto dead = [&](size_t row) {
+            return row / 64 < deathBitmap.size() && (deathBitmap[row / 64] >> (row % 64) & 1);
+        };
+        size_t deaths = 0, firstDead = count;
+        for (size_t word = 0; word < deathBitmap.size() && word * 64 < count; ++word) {
+            uint64_t bits = deathBitmap[word];
+            if ((word + 1) * 64 > count) {
+                bits &= (~0ULL) >> ((word + 1) * 64 - count);
+            }
+            for (; bits != 0; bits &= bits - 1) {
+                size_t row = word * 64 + __builtin_ctzll(bits);
+                uint32_t slot = rowSlots[row];
+                counters->checksum -= rowHash(row);
+                if (counters->journal != nullptr) {
+                    counters->journal->despawn(ids[row]);
+                }
+                ++slotGenerations[slot];
+                freeSlots.push_back(slot);
+                idSlots.erase(ids[row]);
+                firstDead = min(firstDead, row);
+                lazyNames -= nameRefs[row] != 0;
+                ++deaths;
+            }
+        }
+        if (deaths == 0) {
+            return 0;
+        }
+
+        size_t survivors = count - deaths;
+        ++changes;
+        if (deaths >= DESPAWN_PARALLEL_ROWS) {
+            compact(deathBitmap, survivors);
+            markChanged(firstDead, count);
+        } else {
+            markChanged(survivors, count);
+            size_t tail = count;
+            for (size_t word = 0; word * 64 < survivors && word < deathBitmap.size(); ++word) {
+                for (uint64_t bits = deathBitmap[word]; bits != 0; bits &= bits - 1) {
+                    size_t hole = word * 64 + __builtin_ctzll(bits);
+                    if (hole >= survivors) {
+                        break;
+                    }
+                    do {
+                        --tail;
+                    } while (dead(tail));
+                    markChanged(hole, hole + 1);
+                    names[hole] = move(names[tail]);
+                    nameRefs[hole] = nameRefs[tail];
+                    nameHashes[hole] = nameHashes[tail];
+                    health[hole] = health[tail];
+                    attackPower[hole] = attackPower[tail];
+                    ids[hole] = ids[tail];
+                    rowSlots[hole] = rowSlots[tail];
+                    slotRows[rowSlots[hole]] = (uint32_t)hole;
+                }
+            }
+            names.resize(survivors);
+            nameRefs.resize(survivors);
+            nameHashes.resize(survivors);
+            health.resize(survivors);
+            attackPower.resize(survivors);
+            ids.resize(survivors);
+            rowSlots.resize(survivors);
+        }
+        counters->objectCount -= (int)deaths;
+        return deaths;
+    }
+
+    /**
+     * @brief Gets the number of characters in the store.
+     * @return The number of rows.
+     */
+    size_t size() const {
+        return ids.size();
+    }
+
+    /**
+     * @brief Gets raw pointers to the columns for use by query expressions.
+     * @return The column pointers.
+     */
+    CharacterColumns columns() const {
+        return CharacterColumns{names.data(), health.data(), attackPower.data(), ids.data(), nameRefs.data(), nameBase};
+    }
+
+    /**
+     * @brief Evaluates a predicate on every row and returns the matching rows as a bitmap.
+     * 
+     * Bit i of word i / 64 is set when row i matches. Chunks of rows are evaluated in parallel.
+     * 
+     * @param predicate The query expression to evaluate.
+     * @return The selection bitmap with one bit per row.
+     */
+    template <class Predicate>
+    vector<uint64_t> filter(const query::Expression<Predicate> &predicate) const {
+        const Predicate &expression = predicate.self();
+        CharacterColumns rows = columns();
+        vector<uint64_t> bitmap((size() + 63) / 64, 0);
+        parallelForChunks(size(), QUERY_CHUNK, [&](size_t, size_t begin, size_t end) {
+            for (size_t first = begin; first < end; first += 64) {
+                size_t last = min(end, first + 64);
+                uint64_t bits = 0;
+                for (size_t row = first; row < last; ++row) {
+                    bits |= (uint64_t)(expression.eval(rows, row) != 0) << (row - first);
+                }
+                bitmap[first / 64] = bits;
+            }
+        }, workers);
+        return bitmap;
+    }
+
+    /**
+     * @brief Evaluates a predicate on every row and returns the matching row indices.
+     * @param predicate The query expression to evaluate.
+     * @return The ascending selection vector of matching rows.
+     */
+    template <class Predicate>
+    vector<uint32_t> select(const query::Expression<Predicate> &predicate) const {
+        return toSelection(filter(predicate));
+    }
+
+    /**
+     * @brief Counts the rows that match a predicate.
+     * @param predicate The query expression to evaluate.
+     * @return The number of matching rows.
+     */
+    template <class Predicate>
+    size_t count(const query::Expression<Predicate> &predicate) const {
+        size_t total = 0;
+        for (uint64_t word : filter(predicate)) {
+            total += __builtin_popcountll(word);
+        }
+        return total;
+    }
+
+    /**
+     * @brief Assigns an expression to a numeric column on every row that matches a predicate.
+     * 
+     * The predicate, the new value and the validation are evaluated in one fused pass over the
+     * columns, without temporary arrays, with chunks of rows processed in parallel. With
+     * REJECT_INVALID, a read-only pass first checks every new value so that a failing update
+     * changes nothing. The ID column cannot be updated. Invincibility is decided by the old
+     * value: invincible characters keep health -1, and a computed health never makes a
+     * character invincible; like damage, it stops at 0. Changed rows are reported to the
+     * world's journal in row order.
+     * 
+     * @param column The column to assign, query::health or query::attackPower.
+     * @param value The expression computing the new value of a row.
+     * @param where The predicate selecting the rows to update.
+     * @param policy How values outside the valid range are handled.
+     * @return The number of updated rows.
+     * @throw std::invalid_argument If the policy is REJECT_INVALID and a new value is invalid.
+     */
+    template <query::Field F, class Value, class Predicate>
+    size_t update(const query::Column<F> &, const query::Expression<Value> &value,
+                  const query::Expression<Predicate> &where, UpdatePolicy policy = CLAMP_VALUES) {
+        static_assert(F != query::ID, "Character IDs cannot be updated.");
+        const Value &newValue = value.self();
+        const Predicate &predicate = where.self();
+        CharacterColumns rows = columns();
+        int *target = F == query::HEALTH ? health.data() : attackPower.data();
+
+        if (policy == REJECT_INVALID) {
+            atomic<size_t> firstInvalid(size());
+            parallelForChunks(size(), QUERY_CHUNK, [&](size_t, size_t begin, size_t end) {
+                for (size_t row = begin; row < end; ++row) {
+                    if (predicate.eval(rows, row) && !isValid<F>(target[row], newValue.eval(rows, row))) {
+                        size_t seen = firstInvalid.load();
+                        while (row < seen && !firstInvalid.compare_exchange_weak(seen, row)) {
+                        }
+                        return;
+                    }
+                }
+            }, workers);
+            if (firstInvalid < size()) {
+                size_t row = firstInvalid;
+                int invalid = newValue.eval(rows, row);
+                if (F == query::HEALTH && invalid == -1) {
+                    throw invalid_argument("Health updates cannot make a character invincible.");
+                }
+                if (F == query::HEALTH) {
+                    GameCharacter::validate("Name", invalid, 0);
+                } else {
+                    GameCharacter::validate("Name", -1, invalid);
+                }
+            }
+        }
+
+        atomic<size_t> updated(0);
+        atomic<uint64_t> checksumDelta(0);
+        vector<vector<uint32_t>> changed(counters->journal != nullptr ? (size() + QUERY_CHUNK - 1) / QUERY_CHUNK : 0);
+        uint64_t stamp = ++changes;
+        parallelForChunks(size(), QUERY_CHUNK, [&](size_t chunk, size_t begin, size_t end) {
+            size_t matched = 0;
+            uint64_t delta = 0;
+            for (size_t row = begin; row < end; ++row) {
+                int selected = predicate.eval(rows, row) != 0;
+                int old = target[row];
+                int result = clampValue<F>(old, newValue.eval(rows, row));
+                target[row] = selected ? result : old;
+                matched += selected;
+                if (selected && result != old) {
+                    delta += rowHash(row);
+                    target[row] = old;
+                    delta -= rowHash(row);
+                    target[row] = result;
+                    chunkChanges[row / STORE_CHANGE_CHUNK] = stamp;
+                    if (!changed.empty()) {
+                        changed[chunk].push_back((uint32_t)row);
+                    }
+                }
+            }
+            updated += matched;
+            checksumDelta += delta;
+        }, workers);
+        counters->checksum += checksumDelta;
+        for (const vector<uint32_t> &rowsOfChunk : changed) {
+            for (uint32_t row : rowsOfChunk) {
+                counters->journal->set(ids[row], health[row], attackPower[row]);
+            }
+        }
+        return updated;
+    }
+
+    /**
+     * @brief Assigns an expression to a numeric column on every row.
+     * 
+     * @param column The column to assign, query::health or query::attackPower.
+     * @param value The expression computing the new value of a row.
+     * @param policy How values outside the valid range are handled.
+     * @return The number of updated rows.
+     * @throw std::invalid_argument If the policy is REJECT_INVALID and a new value is invalid.
+     */
+    template <query::Field F, class Value>
+    size_t update(const query::Column<F> &column, const query::Expression<Value> &value,
+                  UpdatePolicy policy = CLAMP_VALUES) {
+        return update(column, value, query::Constant(1), policy);
+    }
+
+    /**
+     * @brief Reads health and attack power of the rows addressed through an index list.
+     * 
+     * The column entries of the row distance positions ahead are prefetched while the current
+     * row is read, which hides most cache misses of random target lists.
+     * 
+     * @param rows The row indices to read.
+     * @param count The number of indices.
+     * @param health Receives the health of each addressed row.
+     * @param attackPower Receives the attack power of each addressed row.
+     * @param distance How many entries ahead to prefetch, or 0 to disable prefetching.
+     */
+    void gather(const uint32_t *rows, size_t count, int *health, int *attackPower,
+                size_t distance = PREFETCH_DISTANCE) const {
+        const int *healthColumn = this->health.data();
+        const int *attackColumn = this->attackPower.data();
+        for (size_t i = 0; i < count; ++i) {
+            if (distance != 0 && i + distance < count) {
+                __builtin_prefetch(&healthColumn[rows[i + distance]]);
+                __builtin_prefetch(&attackColumn[rows[i + distance]]);
+            }
+            health[i] = healthColumn[rows[i]];
+            attackPower[i] = attackColumn[rows[i]];
+        }
+    }
+
+    /**
+     * @brief Converts a selection bitmap into an ascending vector of row indices.
+     * 
+     * Set bits are counted per chunk, so every chunk can write its indices in parallel.
+     * 
+     * @param bitmap The selection bitmap with one bit per row.
+     * @return The selection vector.
+     */
+    vector<uint32_t> toSelection(const vector<uint64_t> &bitmap) const {
+        const size_t chunkWords = QUERY_CHUNK / 64;
+        size_t chunks = (bitmap.size() + chunkWords - 1) / chunkWords;
+        vector<size_t> offsets(chunks + 1, 0);
+        parallelForChunks(bitmap.size(), chunkWords, [&](size_t chunk, size_t begin, size_t end) {
+            size_t total = 0;
+            for (size_t word = begin; word < end; ++word) {
+                total += __builtin_popcountll(bitmap[word]);
+            }
+            offsets[chunk + 1] = total;
+        }, workers);
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            offsets[chunk + 1] += offsets[chunk];
+        }
+        vector<uint32_t> selection(offsets[chunks]);
+        parallelForChunks(bitmap.size(), chunkWords, [&](size_t chunk, size_t begin, size_t end) {
+            size_t out = offsets[chunk];
+            for (size_t word = begin; word < end; ++word) {
+                for (uint64_t bits = bitmap[word]; bits != 0; bits &= bits - 1) {
+                    selection[out++] = (uint32_t)(word * 64 + __builtin_ctzll(bits));
+                }
+            }
+        }, workers);
+        return selection;
+    }
+
+private:
+    CharacterCounters *counters;
+    vector<uint32_t> slotRows;
+    vector<uint32_t> slotGenerations;
+    vector<uint32_t> freeSlots;
+    unordered_map<CharacterId, uint32_t> idSlots;
+
+    /**
+     * @brief Name hash of every row, see characterNameHash().
+     */
+    vector<uint64_t> nameHashes;
+
+    uint64_t changes = 0;
+    vector<uint64_t> chunkChanges;
+
+    /**
+     * @brief Per row the offset << 8 | 0x80 | length of a name not yet materialized, or 0.
+     */
+    vector<uint64_t> nameRefs;
+    const char *nameBase = nullptr;
+    size_t lazyNames = 0;
+    NameMetrics nameMetrics = {0, 0};
+
+    /**
+     * @brief Reads and checks a name that still refers to a snapshot.
+     * 
+     * @param row The row.
+     * @return The name.
+     * @throw std::invalid_argument If the name is invalid or does not match its snapshot hash.
+     */
+    string restoredName(size_t row) const {
+        string name(columns().name(row));
+        NameDfa::validate(name);
+        if (characterNameHash(name.data(), name.size()) != nameHashes[row]) {
+            throw invalid_argument("Restored name of character " + to_string(ids[row]) + " is corrupt.");
+        }
+        return name;
+    }
+
+    /**
+     * @brief Drops the snapshot reference of a row whose name was just materialized or replaced.
+     * @param row The row.
+     */
+    void touchName(size_t row) {
+        if (nameRefs[row] != 0) {
+            nameRefs[row] = 0;
+            --lazyNames;
+            ++nameMetrics.touched;
+        }
+    }
+
+    /**
+     * @brief Marks the chunk of a row changed by a new change.
+     * @param row The changed row.
+     */
+    void markChanged(size_t row) {
+        chunkChanges[row / STORE_CHANGE_CHUNK] = ++changes;
+    }
+
+    /**
+     * @brief Marks the chunks of a range of rows changed by the current change.
+     * @param begin The first changed row.
+     * @param end One past the last changed row.
+     */
+    void markChanged(size_t begin, size_t end) {
+        for (size_t chunk = begin / STORE_CHANGE_CHUNK; chunk * STORE_CHANGE_CHUNK < end; ++chunk) {
+            chunkChanges[chunk] = changes;
+        }
+    }
+
+    /**
+     * @brief Moves the surviving rows into fresh columns in parallel, preserving their order.
+     * @param deathBitmap One bit per row marking the rows to drop.
+     * @param survivors The number of rows that survive.
+     */
+    void compact(const vector<uint64_t> &deathBitmap, size_t survivors) {
+        size_t count = size();
+        size_t chunks = (count + QUERY_CHUNK - 1) / QUERY_CHUNK;
+        auto alive = [&](size_t row) {
+            return !(row / 64 < deathBitmap.size() && (deathBitmap[row / 64] >> (row % 64) & 1));
+        };
+        vector<size_t> offsets(chunks + 1, 0);
+        parallelForChunks(count, QUERY_CHUNK, [&](size_t chunk, size_t begin, size_t end) {
+            size_t live = 0;
+            for (size_t row = begin; row < end; ++row) {
+                live += alive(row);
+            }
+            offsets[chunk + 1] = live;
+        }, workers);
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            offsets[chunk + 1] += offsets[chunk];
+        }
+        vector<string> newNames(survivors);
+        vector<int> newHealth(survivors), newAttackPower(survivors);
+        vector<CharacterId> newIds(survivors);
+        vector<uint32_t> newRowSlots(survivors);
+        vector<uint64_t> newNameHashes(survivors), newNameRefs(survivors);
+        parallelForChunks(count, QUERY_CHUNK, [&](size_t chunk, size_t begin, size_t end) {
+            size_t out = offsets[chunk];
+            for (size_t row = begin; row < end; ++row) {
+                if (alive(row)) {
+                    newNames[out] = move(names[row]);
+                    newNameHashes[out] = nameHashes[row];
+                    newNameRefs[out] = nameRefs[row];
+                    newHealth[out] = health[row];
+                    newAttackPower[out] = attackPower[row];
+                    newIds[out] = ids[row];
+                    newRowSlots[out] = rowSlots[row];
+                    slotRows[rowSlots[row]] = (uint32_t)out;
+                    ++out;
+                }
+            }
+        }, workers);
+        names.swap(newNames);
+        health.swap(newHealth);
+        attackPower.swap(newAttackPower);
+        ids.swap(newIds);
+        rowSlots.swap(newRowSlots);
+        nameHashes.swap(newNameHashes);
+        nameRefs.swap(newNameRefs);
+    }
+
+    /**
+     * @brief Gets the share of a row in the world checksum.
+     * @param row The row.
+     * @return The characterHash() of the row.
+     */
+    uint64_t rowHash(size_t row) const {
+        return mixCharacterHash(nameHashes[row], ids[row], health[row], attackPower[row]);
+    }
+
+    /**
+     * @brief Checks a computed value against the validation rules of a column.
+     * 
+     * Invincible characters ignore health updates; the health of others must end up in
+     * [0, MAX_HEALTH], where 0 is the store's dead state that GameCharacter does not have.
+     * 
+     * @param old The current value of the row.
+     * @param value The value to check.
+     * @return True if the value may be stored.
+     */
+    template <query::Field F>
+    static bool isValid(int old, int value) {
+        if (F == query::HEALTH) {
+            return old == -1 || (value >= 0 && value <= MAX_HEALTH);
+        }
+        return value <= MAX_POWER;
+    }
+
+    /**
+     * @brief Clamps a computed value into the range accepted by isValid().
+     * 
+     * @param old The current value of the row.
+     * @param value The value to clamp.
+     * @return The closest valid value.
+     */
+    template <query::Field F>
+    static int clampValue(int old, int value) {
+        if (F == query::HEALTH) {
+            return old == -1 ? -1 : (value < 0 ? 0 : (value > MAX_HEALTH ? MAX_HEALTH : value));
+        }
+        return value > MAX_POWER ? MAX_POWER : value;
+    }
+};
+
+/**
+ * @brief A lightweight reference to one row of a CharacterStore.
+ * 
+ * The getters mirror those of GameCharacter, so generic code can read either.
+ */
+struct CharacterRow {
+    CharacterColumns columns;
+    size_t row;
+
+    string getName() const {
+        return string(columns.name(row));
+    }
+
+    int getHealth() const {
+        return columns.health[row];
+    }
+
+    int getAttackPower() const {
+        return columns.attackPower[row];
+    }
+
+    CharacterId getPersonalId() const {
+        return columns.ids[row];
+    }
+};
+
+/**
+ * @brief Projection yielding CharacterRow references.
+ */
+struct RowProjection {
+    typedef CharacterRow value_type;
+    typedef CharacterRow reference;
+
+    static reference get(const CharacterColumns &columns, size_t row) {
+        return CharacterRow{columns, row};
+    }
+};
+
+/**
+ * @brief Projection yielding the names of the rows.
+ */
+struct NameProjection {
+    typedef string value_type;
+    typedef string reference;
+
+    static reference get(const CharacterColumns &columns, size_t row) {
+        return string(columns.name(row));
+    }
+};
+
+/**
+ * @class CharacterView
+ * @brief A lazy, non-allocating view over the rows of a CharacterStore that match a predicate.
+ * 
+ * The iterator walks the contiguous columns and skips rows for which the query expression
+ * is false; nothing is materialized. Views are built with the adaptors alive(), invincible(),
+ * withPowerAbove() and names() and composed with operator|, for example
+ * `store | alive() | withPowerAbove(100) | names()`. Under C++20 a view also models
+ * std::ranges::view, so it composes with the standard range adaptors.
+ */
+template <class Predicate, class Projection>
+class CharacterView
+#if __cplusplus >= 202002L
+    : public ranges::view_interface<CharacterView<Predicate, Projection>>
+#endif
+{
+public:
+    class iterator {
+    public:
+        typedef input_iterator_tag iterator_category;
+        typedef forward_iterator_tag iterator_concept;
+        typedef ptrdiff_t difference_type;
+        typedef typename Projection::value_type value_type;
+        typedef typename Projection::reference reference;
+        typedef void pointer;
+
+        iterator() : predicate(nullptr), row(0), end(0), rows() {}
+
+        iterator(const CharacterView *view, size_t row)
+            : predicate(&view->predicate), row(row), end(view->store->size()), rows(view->store->columns()) {
+            skip();
+        }
+
+        reference operator*() const {
+            return Projection::get(rows, row);
+        }
+
+        iterator &operator++() {
+            ++row;
+            skip();
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const iterator &other) const {
+            return row == other.row;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return row != other.row;
+        }
+
+        /**
+         * @brief Gets the store row the iterator points to.
+         * @return The row index.
+         */
+        size_t index() const {
+            return row;
+        }
+
+    private:
+        const Predicate *predicate;
+        size_t row;
+        size_t end;
+        CharacterColumns rows;
+
+        void skip() {
+            while (row < end && !predicate->eval(rows, row)) {
+                ++row;
+            }
+        }
+    };
+
+    const CharacterStore *store;
+    Predicate predicate;
+
+    CharacterView(const CharacterStore *store, const Predicate &predicate) : store(store), predicate(predicate) {}
+
+    iterator begin() const {
+        return iterator(this, 0);
+    }
+
+    iterator end() const {
+        return iterator(this, store->size());
+    }
+
+    /**
+     * @brief Calls a function for every element of the view.
+     * 
+     * Unlike the iterators, this runs one flat loop over the columns, which the compiler can
+     * if-convert and vectorize like a hand-written loop.
+     * 
+     * @param function Called with each projected element.
+     */
+    template <class Function>
+    void forEach(Function function) const {
+        CharacterColumns rows = store->columns();
+        size_t count = store->size();
+        for (size_t row = 0; row < count; ++row) {
+            if (predicate.eval(rows, row)) {
+                function(Projection::get(rows, row));
+            }
+        }
+    }
+};
+
+/**
+ * @brief Adaptor narrowing a view to the rows matching a query expression.
+ */
+template <class Predicate>
+struct FilterAdaptor {
+    Predicate predicate;
+};
+
+/**
+ * @brief Adaptor projecting a view onto the names of its rows.
+ */
+struct NamesAdaptor {};
+
+/**
+ * @brief Selects characters whose health has not dropped to 0 (invincible characters included).
+ * @return The filter adaptor.
+ */
+inline FilterAdaptor<query::Binary<query::NotEqual, query::Column<query::HEALTH>, query::Constant>> alive() {
+    return {query::health != 0};
+}
+
+/**
+ * @brief Selects invincible characters (health -1).
+ * @return The filter adaptor.
+ */
+inline FilterAdaptor<query::Binary<query::Equal, query::Column<query::HEALTH>, query::Constant>> invincible() {
+    return {query::invincible};
+}
+
+/**
+ * @brief Selects characters with attack power greater than the given value.
+ * @param power The exclusive lower bound of the attack power.
+ * @return The filter adaptor.
+ */
+inline FilterAdaptor<query::Binary<query::Greater, query::Column<query::ATTACK_POWER>, query::Constant>> withPowerAbove(int power) {
+    return {query::attackPower > power};
+}
+
+/**
+ * @brief Projects a view onto the names of its characters.
+ * @return The projection adaptor.
+ */
+inline NamesAdaptor names() {
+    return NamesAdaptor();
+}
+
+template <class Predicate>
+CharacterView<Predicate, RowProjection> operator|(const CharacterStore &store, const FilterAdaptor<Predicate> &adaptor) {
+    return CharacterView<Predicate, RowProjection>(&store, adaptor.predicate);
+}
+
+template <class Predicate, class Projection, class Next>
+CharacterView<query::Binary<query::And, Predicate, Next>, Projection> operator|(const CharacterView<Predicate, Projection> &view, const FilterAdaptor<Next> &adaptor) {
+    typedef query::Binary<query::And, Predicate, Next> Combined;
+    return CharacterView<Combined, Projection>(view.store, Combined(view.predicate, adaptor.predicate));
+}
+
+inline CharacterView<query::Constant, NameProjection> operator|(const CharacterStore &store, NamesAdaptor) {
+    return CharacterView<query::Constant, NameProjection>(&store, query::Constant(1));
+}
+
+template <class Predicate>
+CharacterView<Predicate, NameProjection> operator|(const CharacterView<Predicate, RowProjection> &view, NamesAdaptor) {
+    return CharacterView<Predicate, NameProjection>(view.store, view.predicate);
+}
+
+#define COMPRESSION_MAGIC 0x4b4c4243u
+#define COMPRESSION_BLOCK_SIZE 65536
+#define COMPRESSION_MAX_BLOCK_SIZE 65536
+#define COMPRESSION_HASH_BITS 12
+#define COMPRESSION_MIN_MATCH 4
+#define COMPRESSION_STORED 0x80000000u
+#define MIGRATION_COMPRESSED (1ULL << 63)
+#define MAX_MIGRATION_FRAME (1ULL << 30)
+
+/**
+ * @brief Appends a value as a LEB128 variable-length integer.
+ */
+inline void putVarint(vector<uint8_t> &buffer, size_t value) {
+    while (value >= 0x80) {
+        buffer.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((uint8_t)value);
+}
+
+/**
+ * @brief Compresses one block with a byte-oriented LZ77 scheme.
+ * 
+ * The block is a list of sequences. Each starts with a token byte: the literal count in the
+ * high nibble (15 means a varint with the rest follows), a repeat flag in bit 3, and a match
+ * code in the low 3 bits (0 ends the block, 1 to 6 mean matches of 4 to 9 bytes, 7 means a
+ * varint with the rest follows). Then come the literal bytes and, unless the match repeats
+ * the previous offset, a 2-byte back reference. Fixed-size records repeat at a constant
+ * stride, so the repeat offset is tried first; other matches are found through a small hash
+ * table of 4-byte prefixes.
+ * 
+ * @param data The block.
+ * @param length The block size in bytes, at most 65536 so that every offset fits 16 bits.
+ * @return The compressed block.
+ */
+inline vector<uint8_t> compressBlock(const uint8_t *data, size_t length) {
+    vector<uint8_t> output;
+    output.reserve(length / 2 + 16);
+    uint32_t table[1 << COMPRESSION_HASH_BITS];
+    fill(begin(table), end(table), UINT32_MAX);
+    auto load = [data](size_t position) {
+        uint32_t value;
+        memcpy(&value, data + position, 4);
+        return value;
+    };
+    auto emit = [&](size_t anchor, size_t literals, size_t match, size_t offset, bool repeat) {
+        size_t code = match == 0 ? 0 : min<size_t>(match - 3, 7);
+        output.push_back((uint8_t)(min<size_t>(literals, 15) << 4 | (repeat ? 8 : 0) | code));
+        if (literals >= 15) {
+            putVarint(output, literals - 15);
+        }
+        output.insert(output.end(), data + anchor, data + anchor + literals);
+        if (code == 7) {
+            putVarint(output, match - 10);
+        }
+        if (match != 0 && !repeat) {
+            putLittleEndian(output, offset, 2);
+        }
+    };
+    size_t anchor = 0;
+    size_t position = 0;
+    size_t lastOffset = 0;
+    while (position + COMPRESSION_MIN_MATCH <= length) {
+        uint32_t word = load(position);
+        uint32_t hash = (word * 2654435761u) >> (32 - COMPRESSION_HASH_BITS);
+        uint32_t candidate = table[hash];
+        table[hash] = (uint32_t)position;
+        size_t offset;
+        if (lastOffset != 0 && lastOffset <= position && load(position - lastOffset) == word) {
+            offset = lastOffset;
+        } else if (candidate != UINT32_MAX && position - candidate <= 0xffff && load(candidate) == word) {
+            offset = position - candidate;
+        } else {
+            ++position;
+            continue;
+        }
+        size_t match = COMPRESSION_MIN_MATCH;
+        while (position + match < length && data[position - offset + match] == data[position + match]) {
+            ++match;
+        }
+        emit(anchor, position - anchor, match, offset, offset == lastOffset);
+        lastOffset = offset;
+        position += match;
+        anchor = position;
+    }
+    emit(anchor, length - anchor, 0, 0, false);
+    return output;
+}
+
+/**
+ * @brief Decompresses one block written by compressBlock().
+ * 
+ * Short literal runs and matches are copied 16 bytes at a time when there is room, which
+ * keeps the common case free of byte loops.
+ * 
+ * @param data The compressed block.
+ * @param length The compressed size in bytes.
+ * @param output Receives the block.
+ * @param capacity The expected block size in bytes.
+ * @throw std::invalid_argument If the block is corrupt or does not have the expected size.
+ */
+inline void decompressBlock(const uint8_t *data, size_t length, uint8_t *output, size_t capacity) {
+    size_t in = 0, out = 0, offset = 0;
+    auto varint = [&]() {
+        size_t value = 0;
+        for (int shift = 0; in < length && shift < 64; shift += 7) {
+            uint8_t byte = data[in++];
+            value |= (size_t)(byte & 0x7f) << shift;
+            if (byte < 0x80) {
+                return value;
+            }
+        }
+        throw invalid_argument("Compressed block is corrupt.");
+    };
+    while (true) {
+        if (in >= length) {
+            throw invalid_argument("Compressed block is corrupt.");
+        }
+        uint8_t token = data[in++];
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            literals += varint();
+        }
+        if (literals > length - in || literals > capacity - out) {
+            throw invalid_argument("Compressed block is corrupt.");
+        }
+        if (literals <= 16 && length - in >= 16 && capacity - out >= 16) {
+            memcpy(output + out, data + in, 16);
+        } else {
+            memcpy(output + out, data + in, literals);
+        }
+        in += literals;
+        out += literals;
+        size_t code = token & 7;
+        if (code == 0) {
+            break;
+        }
+        size_t match = code == 7 ? 10 + varint() : code + 3;
+        if (!(token & 8)) {
+            if (in + 2 > length) {
+                throw invalid_argument("Compressed block is corrupt.");
+            }
+            offset = getLittleEndian(data + in, 2);
+            in += 2;
+        }
+        if (offset == 0 || offset > out || match > capacity - out) {
+            throw invalid_argument("Compressed block is corrupt.");
+        }
+        const uint8_t *source = output + out - offset;
+        if (match <= 16 && offset >= 16 && capacity - out >= 16) {
+            memcpy(output + out, source, 16);
+        } else if (offset >= match) {
+            memcpy(output + out, source, match);
+        } else {
+            for (size_t i = 0; i < match; ++i) {
+                output[out + i] = source[i];
+            }
+        }
+        out += match;
+    }
+    if (in != length || out != capacity) {
+        throw invalid_argument("Compressed block is corrupt.");
+    }
+}
+
+/**
+ * @brief Compresses a buffer as independent blocks, several blocks at a time.
+ * 
+ * The result holds a magic number, the block size, the raw size and the block count,
+ * followed by the compressed size of every block and then the blocks. Blocks that do not
+ * shrink are stored raw and flagged with COMPRESSION_STORED. Because blocks do not refer to
+ * each other, each one can be decompressed on its own.
+ * 
+ * @param raw The buffer to compress.
+ * @param blockSize The raw size of each block except the last, at most 65536 bytes.
+ * @param workers The number of threads to use, or 0 for the hardware concurrency.
+ * @return The compressed buffer.
+ * @throw std::invalid_argument If the block size is 0 or larger than 65536.
+ */
+vector<uint8_t> compressBlocks(const vector<uint8_t> &raw, size_t blockSize = COMPRESSION_BLOCK_SIZE, unsigned workers = 0) {
+    if (blockSize == 0 || blockSize > COMPRESSION_MAX_BLOCK_SIZE) {
+        throw invalid_argument("Compression block size must be between 1 and 65536 bytes.");
+    }
+    size_t count = (raw.size() + blockSize - 1) / blockSize;
+    vector<vector<uint8_t>> blocks(count);
+    parallelForChunks(count, 1, [&](size_t block, size_t, size_t) {
+        size_t begin = block * blockSize;
+        size_t length = min(blockSize, raw.size() - begin);
+        blocks[block] = compressBlock(raw.data() + begin, length);
+        if (blocks[block].size() >= length) {
+            blocks[block].assign(raw.begin() + begin, raw.begin() + begin + length);
+        }
+    }, workers);
+
+    vector<uint8_t> packed;
+    putLittleEndian(packed, COMPRESSION_MAGIC, 4);
+    putLittleEndian(packed, blockSize, 4);
+    putLittleEndian(packed, raw.size(), 8);
+    putLittleEndian(packed, count, 4);
+    for (size_t block = 0; block < count; ++block) {
+        size_t length = min(blockSize, raw.size() - block * blockSize);
+        putLittleEndian(packed, blocks[block].size() | (blocks[block].size() == length ? COMPRESSION_STORED : 0), 4);
+    }
+    for (const vector<uint8_t> &block : blocks) {
+        packed.insert(packed.end(), block.begin(), block.end());
+    }
+    return packed;
+}
+
+/**
+ * @class CompressedBlocks
+ * @brief Random access to the blocks of a buffer written by compressBlocks().
+ */
+class CompressedBlocks {
+public:
+    /**
+     * @brief Constructor to index a compressed buffer.
+     * @param packed The compressed buffer; it must outlive this object.
+     * @throw std::invalid_argument If the buffer is not a complete compressed buffer.
+     */
+    CompressedBlocks(const vector<uint8_t> &packed) : packed(packed) {
+        if (packed.size() < 20 || getLittleEndian(packed.data(), 4) != COMPRESSION_MAGIC) {
+            throw invalid_argument("Not a compressed block buffer.");
+        }
+        blockSize = getLittleEndian(packed.data() + 4, 4);
+        size = getLittleEndian(packed.data() + 8, 8);
+        size_t count = getLittleEndian(packed.data() + 16, 4);
+        if (blockSize == 0 || blockSize > COMPRESSION_MAX_BLOCK_SIZE || count != (size + blockSize - 1) / blockSize
+            || 20 + count * 4 > packed.size()) {
+            throw invalid_argument("Compressed block header is corrupt.");
+        }
+        size_t offset = 20 + count * 4;
+        for (size_t block = 0; block < count; ++block) {
+            uint32_t entry = (uint32_t)getLittleEndian(packed.data() + 20 + block * 4, 4);
+            offsets.push_back(offset);
+            stored.push_back((entry & COMPRESSION_STORED) != 0);
+            offset += entry & ~COMPRESSION_STORED;
+        }
+        offsets.push_back(offset);
+        if (offset != packed.size()) {
+            throw invalid_argument("Compressed block buffer is truncated.");
+        }
+    }
+
+    size_t blockCount() const {
+        return stored.size();
+    }
+
+    size_t rawSize() const {
+        return size;
+    }
+
+    /**
+     * @brief Gets the raw size of a block.
+     * @param block The block number.
+     * @return The size in bytes.
+     */
+    size_t blockLength(size_t block) const {
+        return min(blockSize, size - block * blockSize);
+    }
+
+    /**
+     * @brief Decompresses a single block.
+     * 
+     * @param block The block number.
+     * @param output Receives blockLength(block) bytes.
+     * @throw std::invalid_argument If the block is corrupt.
+     */
+    void decompress(size_t block, uint8_t *output) const {
+        const uint8_t *data = packed.data() + offsets[block];
+        size_t length = offsets[block + 1] - offsets[block];
+        if (!stored[block]) {
+            decompressBlock(data, length, output, blockLength(block));
+        } else if (length == blockLength(block)) {
+            memcpy(output, data, length);
+        } else {
+            throw invalid_argument("Compressed block is corrupt.");
+        }
+    }
+
+    /**
+     * @brief Decompresses every block, several blocks at a time.
+     * @param workers The number of threads to use, or 0 for the hardware concurrency.
+     * @return The raw buffer.
+     * @throw std::invalid_argument If a block is corrupt.
+     */
+    vector<uint8_t> decompressAll(unsigned workers = 0) const {
+        vector<uint8_t> raw(size);
+        atomic<bool> corrupt(false);
+        parallelForChunks(blockCount(), 1, [&](size_t block, size_t, size_t) {
+            try {
+                decompress(block, raw.data() + block * blockSize);
+            } catch (invalid_argument &) {
+                corrupt = true;
+            }
+        }, workers);
+        if (corrupt) {
+            throw invalid_argument("Compressed block is corrupt.");
+        }
+        return raw;
+    }
+
+private:
+    const vector<uint8_t> &packed;
+    size_t blockSize;
+    size_t size;
+    vector<size_t> offsets;
+    vector<bool> stored;
+};
+
+/**
+ * @brief Streams a migration buffer over a pipe or socket, prefixed with its length.
+ * 
+ * A compressed buffer goes through compressBlocks() first and is marked by the top bit of the
+ * length prefix, so readMigration() accepts either form. Buffers larger than
+ * MAX_MIGRATION_FRAME bytes are refused on both ends.
+ * 
+ * @param fd The file descriptor to write to.
+ * @param buffer The migration buffer.
+ * @param compress Whether to compress the buffer on the way.
+ * @throw std::runtime_error If the buffer is too large or writing fails.
+ */
+void writeMigration(int fd, const vector<uint8_t> &buffer, bool compress = false) {
+    if (buffer.size() > MAX_MIGRATION_FRAME) {
+        throw runtime_error("Migration buffer exceeds " + to_string(MAX_MIGRATION_FRAME) + " bytes.");
+    }
+    vector<uint8_t> frame;
+    if (compress) {
+        vector<uint8_t> packed = compressBlocks(buffer);
+        putLittleEndian(frame, packed.size() | MIGRATION_COMPRESSED, 8);
+        frame.insert(frame.end(), packed.begin(), packed.end());
+    } else {
+        putLittleEndian(frame, buffer.size(), 8);
+        frame.insert(frame.end(), buffer.begin(), buffer.end());
+    }
+    for (size_t written = 0; written < frame.size();) {
+        ssize_t result = write(fd, frame.data() + written, frame.size() - written);
+        if (result <= 0) {
+            throw runtime_error("Failed to write migration buffer.");
+        }
+        written += result;
+    }
+}
+
+/**
+ * @brief Receives one migration buffer written by writeMigration().
+ * 
+ * The length prefix and the size of a compressed buffer are checked against
+ * MAX_MIGRATION_FRAME before anything is allocated for them.
+ * 
+ * @param fd The file descriptor to read from.
+ * @return The migration buffer, decompressed if it was sent compressed.
+ * @throw std::runtime_error If the buffer is too large, the stream ends early or reading fails.
+ * @throw std::invalid_argument If a compressed buffer is corrupt.
+ */
+vector<uint8_t> readMigration(int fd) {
+    auto readFully = [fd](uint8_t *data, size_t length) {
+        for (size_t done = 0; done < length;) {
+            ssize_t result = read(fd, data + done, length - done);
+            if (result <= 0) {
+                throw runtime_error("Failed to read migration buffer.");
+            }
+            done += result;
+        }
+    };
+    uint8_t header[8];
+    readFully(header, 8);
+    uint64_t length = getLittleEndian(header, 8);
+    if ((length & ~MIGRATION_COMPRESSED) > MAX_MIGRATION_FRAME) {
+        throw runtime_error("Migration buffer exceeds " + to_string(MAX_MIGRATION_FRAME) + " bytes.");
+    }
+    vector<uint8_t> buffer(length & ~MIGRATION_COMPRESSED);
+    readFully(buffer.data(), buffer.size());
+    if (length & MIGRATION_COMPRESSED) {
+        CompressedBlocks blocks(buffer);
+        if (blocks.rawSize() > MAX_MIGRATION_FRAME) {
+            throw runtime_error("Migration buffer exceeds " + to_string(MAX_MIGRATION_FRAME) + " bytes.");
+        }
+        return blocks.decompressAll();
+    }
+    return buffer;
+}
+
+#define COLUMNAR_MAGIC "CHRCOL02"
+#define COLUMNAR_ALIGNMENT 8
+#define COLUMNAR_BATCH_ROWS 65536
+
+static_assert(sizeof(int) == 4, "Columnar export shares int columns as 32-bit Arrow buffers.");
+
+/**
+ * @brief Logical types of the columnar export, following the Arrow type names.
+ */
+enum ColumnarType {
+    COLUMN_UTF8,
+    COLUMN_INT32,
+    COLUMN_INT64
+};
+
+/**
+ * @brief One record batch of characters in the Arrow columnar layout.
+ * 
+ * The name column is an Arrow utf8 array: length + 1 int32 offsets into the concatenated
+ * name bytes. Health, attack power and ID are plain Arrow int32 and int64 arrays, and the
+ * name hash column holds the characterNameHash() of every name as int64, so a restore can
+ * add the names to the world checksum without reading them. No column has nulls, so there
+ * are no validity bitmaps. Exported batches point straight into the numeric columns of the
+ * store and only own the name buffers; batches read from a file
+ * point into the file bytes. Copies and moves take the owned name buffers along and point
+ * into their own; a moved-from batch is empty.
+ */
+struct ColumnarBatch {
+    size_t length = 0;
+    const int32_t *nameOffsets = nullptr;
+    const char *nameData = nullptr;
+    const int32_t *health = nullptr;
+    const int32_t *attackPower = nullptr;
+    const int64_t *ids = nullptr;
+    const uint64_t *nameHashes = nullptr;
+
+    ColumnarBatch() = default;
+
+    ColumnarBatch(const ColumnarBatch &other) {
+        *this = other;
+    }
+
+    ColumnarBatch(ColumnarBatch &&other) noexcept {
+        *this = move(other);
+    }
+
+    ColumnarBatch &operator=(const ColumnarBatch &other) {
+        if (this != &other) {
+            offsetStorage = other.offsetStorage;
+            nameStorage = other.nameStorage;
+            adopt(other, other.ownsNames());
+        }
+        return *this;
+    }
+
+    ColumnarBatch &operator=(ColumnarBatch &&other) noexcept {
+        if (this != &other) {
+            bool owned = other.ownsNames();
+            offsetStorage = move(other.offsetStorage);
+            nameStorage = move(other.nameStorage);
+            adopt(other, owned);
+            other.offsetStorage.clear();
+            other.nameStorage.clear();
+            other.adopt(ColumnarBatch(), false);
+        }
+        return *this;
+    }
+
+    string getName(size_t row) const {
+        return string(nameData + nameOffsets[row], nameOffsets[row + 1] - nameOffsets[row]);
+    }
+
+private:
+    vector<int32_t> offsetStorage;
+    vector<char> nameStorage;
+
+    bool ownsNames() const {
+        return !offsetStorage.empty() && nameOffsets == offsetStorage.data();
+    }
+
+    void adopt(const ColumnarBatch &other, bool owned) {
+        length = other.length;
+        nameOffsets = owned ? offsetStorage.data() : other.nameOffsets;
+        nameData = owned ? nameStorage.data() : other.nameData;
+        health = other.health;
+        attackPower = other.attackPower;
+        ids = other.ids;
+        nameHashes = other.nameHashes;
+    }
+
+    friend ColumnarBatch exportColumnarBatch(const CharacterStore &store, size_t begin, size_t end);
+};
+
+/**
+ * @brief Exports a range of store rows as a record batch without copying the numeric columns.
+ * 
+ * The batch stays valid until the store is changed.
+ * 
+ * @param store The store to export from.
+ * @param begin The first row.
+ * @param end One past the last row.
+ * @return The record batch.
+ */
+ColumnarBatch exportColumnarBatch(const CharacterStore &store, size_t begin, size_t end) {
+    ColumnarBatch batch;
+    batch.length = end - begin;
+    batch.offsetStorage.reserve(batch.length + 1);
+    batch.offsetStorage.push_back(0);
+    CharacterColumns columns = store.columns();
+    for (size_t row = begin; row < end; ++row) {
+        string_view name = columns.name(row);
+        batch.nameStorage.insert(batch.nameStorage.end(), name.begin(), name.end());
+        batch.offsetStorage.push_back((int32_t)batch.nameStorage.size());
+    }
+    batch.nameOffsets = batch.offsetStorage.data();
+    batch.nameData = batch.nameStorage.data();
+    batch.health = store.health.data() + begin;
+    batch.attackPower = store.attackPower.data() + begin;
+    batch.ids = store.ids.data() + begin;
+    batch.nameHashes = store.getNameHashes().data() + begin;
+    return batch;
+}
+
+/**
+ * @class ColumnarWriter
+ * @brief Streams record batches into an IPC-style columnar file.
+ * 
+ * The file starts with a magic string and the schema (per field a type and a name). Each
+ * record batch follows as its row count and its six buffers, every buffer prefixed by its
+ * byte length and padded to COLUMNAR_ALIGNMENT bytes, so a reader can map the file and hand
+ * the buffers to Arrow as they are. A footer with the offset of every batch and the magic
+ * string again closes the file, which allows random access to batches. Batches are written
+ * as they arrive, so the file can go to a pipe or socket.
+ */
+class ColumnarWriter {
+public:
+    /**
+     * @brief Constructor to start a file and write its schema.
+     * @param fd The file descriptor to write to.
+     * @throw std::runtime_error If writing fails.
+     */
+    ColumnarWriter(int fd) : fd(fd) {
+        vector<uint8_t> header(COLUMNAR_MAGIC, COLUMNAR_MAGIC + 8);
+        const pair<ColumnarType, const char *> fields[] = {
+            {COLUMN_UTF8, "name"}, {COLUMN_INT32, "health"}, {COLUMN_INT32, "attackPower"}, {COLUMN_INT64, "id"},
+            {COLUMN_INT64, "nameHash"}};
+        putLittleEndian(header, 5, 4);
+        for (const auto &field : fields) {
+            putLittleEndian(header, field.first, 1);
+            putLittleEndian(header, strlen(field.second), 1);
+            header.insert(header.end(), field.second, field.second + strlen(field.second));
+        }
+        header.resize((header.size() + COLUMNAR_ALIGNMENT - 1) / COLUMNAR_ALIGNMENT * COLUMNAR_ALIGNMENT);
+        emit(header.data(), header.size());
+    }
+
+    /**
+     * @brief Appends one record batch.
+     * @param batch The batch to write.
+     * @throw std::runtime_error If writing fails.
+     */
+    void write(const ColumnarBatch &batch) {
+        batchOffsets.push_back(offset);
+        vector<uint8_t> length;
+        putLittleEndian(length, batch.length, 8);
+        emit(length.data(), length.size());
+        writeBuffer(batch.nameOffsets, (batch.length + 1) * 4);
+        writeBuffer(batch.nameData, batch.nameOffsets[batch.length]);
+        writeBuffer(batch.health, batch.length * 4);
+        writeBuffer(batch.attackPower, batch.length * 4);
+        writeBuffer(batch.ids, batch.length * 8);
+        writeBuffer(batch.nameHashes, batch.length * 8);
+    }
+
+    /**
+     * @brief Writes the footer; no batch may be written afterwards.
+     * @throw std::runtime_error If writing fails.
+     */
+    void finish() {
+        vector<uint8_t> footer;
+        uint64_t footerOffset = offset;
+        putLittleEndian(footer, batchOffsets.size(), 4);
+        for (uint64_t batchOffset : batchOffsets) {
+            putLittleEndian(footer, batchOffset, 8);
+        }
+        putLittleEndian(footer, footerOffset, 8);
+        footer.insert(footer.end(), COLUMNAR_MAGIC, COLUMNAR_MAGIC + 8);
+        emit(footer.data(), footer.size());
+    }
+
+private:
+    int fd;
+    uint64_t offset = 0;
+    vector<uint64_t> batchOffsets;
+
+    void emit(const void *data, size_t length) {
+        const uint8_t *bytes = (const uint8_t *)data;
+        for (size_t written = 0; written < length;) {
+            ssize_t result = ::write(fd, bytes + written, length - written);
+            if (result <= 0) {
+                throw runtime_error("Failed to write columnar file.");
+            }
+            written += result;
+        }
+        offset += length;
+    }
+
+    void writeBuffer(const void *data, size_t length) {
+        static const uint8_t padding[COLUMNAR_ALIGNMENT] = {};
+        vector<uint8_t> prefix;
+        putLittleEndian(prefix, length, 8);
+        emit(prefix.data(), prefix.size());
+        emit(data, length);
+        emit(padding, (COLUMNAR_ALIGNMENT - length % COLUMNAR_ALIGNMENT) % COLUMNAR_ALIGNMENT);
+    }
+};
+
+/**
+ * @brief Streams all characters of a store into a columnar file, one record batch at a time.
+ * 
+ * @param fd The file descriptor to write to.
+ * @param store The store to export.
+ * @param batchRows The maximum number of rows per record batch.
+ * @throw std::runtime_error If writing fails.
+ */
+void writeColumnar(int fd, const CharacterStore &store, size_t batchRows = COLUMNAR_BATCH_ROWS) {
+    ColumnarWriter writer(fd);
+    for (size_t begin = 0; begin < store.size(); begin += batchRows) {
+        writer.write(exportColumnarBatch(store, begin, min(store.size(), begin + batchRows)));
+    }
+    writer.finish();
+}
+
+/**
+ * @class ColumnarFile
+ * @brief Reads record batches from the bytes of a columnar file without copying them.
+ */
+class ColumnarFile {
+public:
+    /**
+     * @brief Constructor to open a columnar file held in memory.
+     * @param bytes The file contents; they must outlive the file and its batches.
+     * @throw std::invalid_argument If the bytes are not a complete columnar file.
+     */
+    ColumnarFile(const vector<uint8_t> &bytes) : ColumnarFile(bytes.data(), bytes.size()) {}
+
+    /**
+     * @brief Constructor to open a columnar file held in memory, e.g. a mapped file.
+     * 
+     * @param bytes The file contents; they must outlive the file and its batches.
+     * @param size The file size in bytes.
+     * @throw std::invalid_argument If the bytes are not a complete columnar file.
+     */
+    ColumnarFile(const uint8_t *bytes, size_t size) : bytes(bytes) {
+        if (size < 28 || memcmp(bytes, COLUMNAR_MAGIC, 8) != 0 || memcmp(bytes + size - 8, COLUMNAR_MAGIC, 8) != 0) {
+            throw invalid_argument("Not a columnar character file.");
+        }
+        uint64_t footer = getLittleEndian(bytes + size - 16, 8);
+        if (footer + 4 > size - 16) {
+            throw invalid_argument("Columnar file footer is corrupt.");
+        }
+        size_t count = getLittleEndian(bytes + footer, 4);
+        if (footer + 4 + count * 8 != size - 16) {
+            throw invalid_argument("Columnar file footer is corrupt.");
+        }
+        for (size_t i = 0; i < count; ++i) {
+            batchOffsets.push_back(getLittleEndian(bytes + footer + 4 + i * 8, 8));
+        }
+        end = footer;
+    }
+
+    /**
+     * @brief Gets the start of the file bytes, against which batch buffers can be located.
+     * @return The file bytes.
+     */
+    const uint8_t *data() const {
+        return bytes;
+    }
+
+    size_t batchCount() const {
+        return batchOffsets.size();
+    }
+
+    /**
+     * @brief Gets a record batch pointing into the file bytes.
+     * 
+     * The name offsets are checked to start at 0, never decrease and end at the size of the
+     * name buffer, so every name lies inside the file. The name bytes are not read.
+     * 
+     * @param index The batch number.
+     * @return The batch.
+     * @throw std::invalid_argument If the batch is truncated or its name offsets are corrupt.
+     */
+    ColumnarBatch batch(size_t index) const {
+        size_t position = batchOffsets.at(index);
+        ColumnarBatch batch;
+        batch.length = read(position, 8);
+        if (batch.length > (end - position) / 4) {
+            throw invalid_argument("Columnar record batch is truncated.");
+        }
+        batch.nameOffsets = (const int32_t *)buffer(position, (batch.length + 1) * 4);
+        if (batch.nameOffsets[0] != 0) {
+            throw invalid_argument("Columnar name offsets are corrupt.");
+        }
+        for (size_t row = 0; row < batch.length; ++row) {
+            if (batch.nameOffsets[row + 1] < batch.nameOffsets[row]) {
+                throw invalid_argument("Columnar name offsets are corrupt.");
+            }
+        }
+        batch.nameData = (const char *)buffer(position, batch.nameOffsets[batch.length]);
+        batch.health = (const int32_t *)buffer(position, batch.length * 4);
+        batch.attackPower = (const int32_t *)buffer(position, batch.length * 4);
+        batch.ids = (const int64_t *)buffer(position, batch.length * 8);
+        batch.nameHashes = (const uint64_t *)buffer(position, batch.length * 8);
+        return batch;
+    }
+
+private:
+    const uint8_t *bytes;
+    vector<uint64_t> batchOffsets;
+    size_t end;
+
+    uint64_t read(size_t &position, size_t length) const {
+        if (position + length > end) {
+            throw invalid_argument("Columnar record batch is truncated.");
+        }
+        position += length;
+        return getLittleEndian(bytes + position - length, (int)length);
+    }
+
+    const uint8_t *buffer(size_t &position, size_t expected) const {
+        if (read(position, 8) != expected || position + expected > end) {
+            throw invalid_argument("Columnar record batch is truncated.");
+        }
+        const uint8_t *data = bytes + position;
+        position += (expected + COLUMNAR_ALIGNMENT - 1) / COLUMNAR_ALIGNMENT * COLUMNAR_ALIGNMENT;
+        return data;
+    }
+};
+/**
+ * @class MappedFile
+ * @brief A read-only memory mapping of a whole file.
+ */
+class MappedFile {
+public:
+    /**
+     * @brief Constructor to map a file.
+     * @param path The path of the file.
+     * @throw std::runtime_error If the file cannot be opened or mapped.
+     */
+    MappedFile(const string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        off_t length = fd < 0 ? -1 : lseek(fd, 0, SEEK_END);
+        if (length <= 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw runtime_error("Cannot open " + path + ".");
+        }
+        void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            throw runtime_error("Cannot map " + path + ".");
+        }
+        bytes = (const uint8_t *)mapped;
+        size = length;
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        munmap((void *)bytes, size);
+    }
+
+    const uint8_t *data() const {
+        return bytes;
+    }
+
+    size_t length() const {
+        return size;
+    }
+
+private:
+    const uint8_t *bytes;
+    size_t size;
+};
+
+vector<CharacterHandle> CharacterStore::restoreColumnar(const ColumnarFile &file) {
+    const char *base = (const char *)file.data();
+    if (lazyNames != 0 && base != nameBase) {
+        for (size_t row = 0; row < size(); ++row) {
+            if (nameRefs[row] != 0) {
+                getName(CharacterHandle{rowSlots[row], slotGenerations[rowSlots[row]]});
+            }
+        }
+    }
+    vector<ColumnarBatch> batches;
+    size_t count = 0;
+    for (size_t index = 0; index < file.batchCount(); ++index) {
+        batches.push_back(file.batch(index));
+        count += batches.back().length;
+    }
+    idSlots.reserve(idSlots.size() + count);
+    vector<uint32_t *> registered;
+    registered.reserve(count);
+    count = 0;
+    for (const ColumnarBatch &restoring : batches) {
+        for (size_t row = 0; row < restoring.length; ++row, ++count) {
+            auto entry = idSlots.emplace(restoring.ids[row], 0);
+            registered.push_back(&entry.first->second);
+            if (!entry.second) {
+                CharacterId duplicate = restoring.ids[row];
+                for (const ColumnarBatch &batch : batches) {
+                    for (size_t added = 0; added < batch.length && count != 0; ++added, --count) {
+                        idSlots.erase(batch.ids[added]);
+                    }
+                }
+                throw invalid_argument("Character ID " + to_string(duplicate) + " is already stored.");
+            }
+        }
+    }
+    nameBase = base;
+    reserve(size() + count);
+    vector<CharacterHandle> restored;
+    restored.reserve(count);
+    for (const ColumnarBatch &batch : batches) {
+        uint64_t region = batch.nameData - base;
+        for (size_t row = 0; row < batch.length; ++row) {
+            uint64_t length = batch.nameOffsets[row + 1] - batch.nameOffsets[row];
+            uint64_t nameRef = (region + batch.nameOffsets[row]) << 8 | 0x80 | min<uint64_t>(length, 0x7f);
+            counters->reserve(batch.ids[row]);
+            ++counters->objectCount;
+            restored.push_back(append(string(), batch.health[row], batch.attackPower[row], batch.ids[row], nameRef,
+                                      batch.nameHashes[row], registered[restored.size()]));
+        }
+    }
+    lazyNames += count;
+    nameMetrics.restored += count;
+    return restored;
+}
+
+#define POOL_PAGE_SIZE 64
+#define DEFRAG_CLOCK_INTERVAL 16
+
+/**
+ * @brief Occupancy figures of a CharacterPool.
+ */
+struct PoolMetrics {
+    size_t live;          ///< Number of characters in the pool.
+    size_t pages;         ///< Number of allocated pages.
+    size_t minimumPages;  ///< Pages needed if every page were full.
+    double occupancy;     ///< Fraction of allocated cells holding a character.
+    double fragmentation; ///< Fraction of allocated pages that a perfect packing would not need.
+};
+
+/**
+ * @brief Result of one incremental defragmentation step.
+ */
+struct DefragmentReport {
+    size_t moved;       ///< Characters relocated during the step.
+    PoolMetrics before; ///< Metrics when the step started.
+    PoolMetrics after;  ///< Metrics when the step ended.
+    bool finished;      ///< True if no further relocation can reduce the page count.
+};
+
+/**
+ * @class CharacterPool
+ * @brief Allocates GameCharacter objects in fixed-size pages and hands out stable handles.
+ * 
+ * Each page holds POOL_PAGE_SIZE characters. Handles and the ID registry go through a slot
+ * table, so characters can be relocated between pages by the incremental defragmenter
+ * without invalidating references held elsewhere.
+ */
+class CharacterPool {
+public:
+    /**
+     * @brief Constructor to create an empty pool.
+     * @param counters The counters of the world the pool belongs to.
+     */
+    CharacterPool(CharacterCounters &counters = GameCharacter::defaultCounters) : counters(&counters), openPage(0) {}
+
+    CharacterPool(const CharacterPool &) = delete;
+    CharacterPool &operator=(const CharacterPool &) = delete;
+
+    /**
+     * @brief Destructor to destroy all characters and release the pages.
+     */
+    ~CharacterPool() {
+        for (size_t page = 0; page < pages.size(); ++page) {
+            if (pages[page]) {
+                for (uint64_t bits = pages[page]->occupied; bits != 0; bits &= bits - 1) {
+                    pages[page]->character(__builtin_ctzll(bits))->~GameCharacter();
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Creates a character in the first page with a free cell.
+     * 
+     * @param name The name of the character.
+     * @param health The health points of the character (positive value or -1 for invincible).
+     * @param attackPower The attack power of the character.
+     * @return The handle of the new character.
+     * @throw std::invalid_argument If name, health, or attack power is invalid.
+     */
+    CharacterHandle create(string name, int health, int attackPower) {
+        GameCharacter::validate(name, health, attackPower);
+        return occupy(*new (freeCell()) GameCharacter(*counters, name, health, attackPower));
+    }
+
+    /**
+     * @brief Creates a character with a known ID, e.g. when a replay is played back.
+     * 
+     * @param name The name of the character.
+     * @param health The health points of the character (positive value or -1 for invincible).
+     * @param attackPower The attack power of the character.
+     * @param id The unique ID of the character.
+     * @return The handle of the new character.
+     * @throw std::invalid_argument If an attribute is invalid or the ID is already pooled.
+     */
+    CharacterHandle create(string name, int health, int attackPower, CharacterId id) {
+        GameCharacter::validate(name, health, attackPower);
+        if (idSlots.count(id) != 0) {
+            throw invalid_argument("Character ID " + to_string(id) + " is already pooled.");
+        }
+        return occupy(*new (freeCell()) GameCharacter(*counters, id, name, health, attackPower));
+    }
+
+    /**
+     * @brief Destroys a character and frees its cell.
+     * @param handle The handle of the character.
+     * @throw std::invalid_argument If the character has already been destroyed.
+     */
+    void destroy(CharacterHandle handle) {
+        GameCharacter &character = get(handle);
+        uint32_t cell = slotCells[handle.slot];
+        if (counters->journal != nullptr) {
+            counters->journal->destroy(character.id);
+        }
+        idSlots.erase(character.id);
+        character.~GameCharacter();
+        pages[cell / POOL_PAGE_SIZE]->occupied &= ~(1ULL << (cell % POOL_PAGE_SIZE));
+        releasePageIfEmpty(cell / POOL_PAGE_SIZE);
+        openPage = min(openPage, (size_t)cell / POOL_PAGE_SIZE);
+        ++slotGenerations[handle.slot];
+        freeSlots.push_back(handle.slot);
+        --live;
+    }
+
+    /**
+     * @brief Checks whether a handle still refers to a character in the pool.
+     * @param handle The handle to check.
+     * @return True if the character has not been destroyed.
+     */
+    bool contains(CharacterHandle handle) const {
+        return handle.slot < slotGenerations.size() && slotGenerations[handle.slot] == handle.generation;
+    }
+
+    /**
+     * @brief Gets the character a handle refers to.
+     * @param handle The handle of the character.
+     * @return The character, valid until it is destroyed or relocated.
+     * @throw std::invalid_argument If the character has been destroyed.
+     */
+    GameCharacter &get(CharacterHandle handle) const {
+        if (!contains(handle)) {
+            throw invalid_argument("Character handle refers to a destroyed character.");
+        }
+        uint32_t cell = slotCells[handle.slot];
+        return *pages[cell / POOL_PAGE_SIZE]->character(cell % POOL_PAGE_SIZE);
+    }
+
+    /**
+     * @brief Looks up a character by its unique ID.
+     * @param id The unique ID of the character.
+     * @return The handle of the character.
+     * @throw std::invalid_argument If no character with this ID is in the pool.
+     */
+    CharacterHandle find(CharacterId id) const {
+        auto found = idSlots.find(id);
+        if (found == idSlots.end()) {
+            throw invalid_argument("No character with ID " + to_string(id) + ".");
+        }
+        return CharacterHandle{found->second, slotGenerations[found->second]};
+    }
+
+    /**
+     * @brief Calls a function for every character, page by page.
+     * @param function Called with a reference to each character.
+     */
+    template <class Function>
+    void forEach(Function function) const {
+        for (const unique_ptr<Page> &page : pages) {
+            if (page) {
+                for (uint64_t bits = page->occupied; bits != 0; bits &= bits - 1) {
+                    function(*page->character(__builtin_ctzll(bits)));
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Gets the number of characters in the pool.
+     * @return The number of live characters.
+     */
+    size_t size() const {
+        return live;
+    }
+
+    /**
+     * @brief Measures how densely the live characters are packed into pages.
+     * @return The current pool metrics.
+     */
+    PoolMetrics metrics() const {
+        PoolMetrics result = {live, 0, (live + POOL_PAGE_SIZE - 1) / POOL_PAGE_SIZE, 1.0, 0.0};
+        for (const unique_ptr<Page> &page : pages) {
+            result.pages += page ? 1 : 0;
+        }
+        if (result.pages != 0) {
+            result.occupancy = (double)live / (result.pages * POOL_PAGE_SIZE);
+            result.fragmentation = 1.0 - (double)result.minimumPages / result.pages;
+        }
+        return result;
+    }
+
+    /**
+     * @brief Relocates characters from sparse pages into dense pages for a bounded time.
+     * 
+     * Meant to be called once per tick. Pages are ranked by occupancy, and characters move
+     * from the sparsest pages into the free cells of the densest ones; emptied pages are
+     * released. Handles and the ID registry are updated with every move, so the pool stays
+     * usable between steps. The clock is read every DEFRAG_CLOCK_INTERVAL moves.
+     * 
+     * @param budget The time this step may take.
+     * @return The number of moves and the metrics before and after the step.
+     */
+    DefragmentReport defragment(chrono::microseconds budget) {
+        auto deadline = chrono::steady_clock::now() + budget;
+        DefragmentReport report = {0, metrics(), PoolMetrics(), false};
+
+        vector<size_t> ranked;
+        for (size_t page = 0; page < pages.size(); ++page) {
+            if (pages[page]) {
+                ranked.push_back(page);
+            }
+        }
+        sort(ranked.begin(), ranked.end(), [&](size_t a, size_t b) {
+            return occupancy(a) > occupancy(b) || (occupancy(a) == occupancy(b) && a < b);
+        });
+
+        if (ranked.empty()) {
+            report.finished = true;
+        }
+        size_t target = 0, source = ranked.size() - 1;
+        while (!report.finished) {
+            while (target < source && pages[ranked[target]]->occupied == ~0ULL) {
+                ++target;
+            }
+            if (target >= source) {
+                report.finished = true;
+                break;
+            }
+            relocate(ranked[source], ranked[target]);
+            ++report.moved;
+            if (!pages[ranked[source]]) {
+                --source;
+            }
+            if (report.moved % DEFRAG_CLOCK_INTERVAL == 0 && chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+        }
+        report.after = metrics();
+        return report;
+    }
+
+private:
+    /**
+     * @brief A page of POOL_PAGE_SIZE character cells with an occupancy bitmap.
+     */
+    struct Page {
+        alignas(GameCharacter) unsigned char storage[POOL_PAGE_SIZE][sizeof(GameCharacter)];
+        uint64_t occupied = 0;
+        uint32_t slots[POOL_PAGE_SIZE];
+
+        GameCharacter *character(unsigned cell) {
+            return reinterpret_cast<GameCharacter *>(storage[cell]);
+        }
+    };
+
+    CharacterCounters *counters;
+    vector<unique_ptr<Page>> pages;
+    size_t openPage;
+    size_t live = 0;
+    vector<uint32_t> slotCells;
+    vector<uint32_t> slotGenerations;
+    vector<uint32_t> freeSlots;
+    unordered_map<CharacterId, uint32_t> idSlots;
+
+    int occupancy(size_t page) const {
+        return __builtin_popcountll(pages[page]->occupied);
+    }
+
+    /**
+     * @brief Moves one character from a source page into a free cell of a target page.
+     * @param from The page to take a character from.
+     * @param to The page with a free cell.
+     */
+    void relocate(size_t from, size_t to) {
+        Page &source = *pages[from];
+        Page &target = *pages[to];
+        unsigned fromCell = __builtin_ctzll(source.occupied);
+        unsigned toCell = __builtin_ctzll(~target.occupied);
+        GameCharacter *character = source.character(fromCell);
+        new (target.character(toCell)) GameCharacter(move(*character));
+        character->~GameCharacter();
+        source.occupied &= ~(1ULL << fromCell);
+        target.occupied |= 1ULL << toCell;
+        target.slots[toCell] = source.slots[fromCell];
+        slotCells[target.slots[toCell]] = (uint32_t)(to * POOL_PAGE_SIZE + toCell);
+        releasePageIfEmpty(from);
+    }
+
+    /**
+     * @brief Finds the first free cell, allocating a page if every page is full.
+     * @return The storage of the free cell.
+     */
+    GameCharacter *freeCell() {
+        while (openPage < pages.size() && pages[openPage] && pages[openPage]->occupied == ~0ULL) {
+            ++openPage;
+        }
+        if (openPage == pages.size()) {
+            pages.emplace_back();
+        }
+        if (!pages[openPage]) {
+            pages[openPage].reset(new Page());
+        }
+        return pages[openPage]->character(__builtin_ctzll(~pages[openPage]->occupied));
+    }
+
+    /**
+     * @brief Marks the cell returned by freeCell() occupied by a new character and gives it a handle.
+     * @param character The character constructed in the cell.
+     * @return The handle of the character.
+     */
+    CharacterHandle occupy(GameCharacter &character) {
+        Page &page = *pages[openPage];
+        unsigned cell = __builtin_ctzll(~page.occupied);
+        page.occupied |= 1ULL << cell;
+
+        uint32_t slot;
+        if (freeSlots.empty()) {
+            slot = (uint32_t)slotCells.size();
+            slotCells.push_back(0);
+            slotGenerations.push_back(0);
+        } else {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        slotCells[slot] = (uint32_t)(openPage * POOL_PAGE_SIZE + cell);
+        page.slots[cell] = slot;
+        idSlots[character.id] = slot;
+        ++live;
+        character.pooled = true;
+        if (counters->journal != nullptr) {
+            counters->journal->create(character.id, character.name, character.health, character.attackPower);
+        }
+        return CharacterHandle{slot, slotGenerations[slot]};
+    }
+
+    void releasePageIfEmpty(size_t page) {
+        if (pages[page]->occupied == 0) {
+            pages[page].reset();
+        }
+    }
+};
+
+#define REPLAY_MAGIC "CHRREPL2"
+#define REPLAY_SNAPSHOT_INTERVAL 64
+
+/**
+ * @brief Operation codes of the replay format.
+ */
+enum ReplayOperation {
+    REPLAY_TICK = 1,
+    REPLAY_SPAWN,
+    REPLAY_RENAME,
+    REPLAY_DAMAGE,
+    REPLAY_DESPAWN,
+    REPLAY_SNAPSHOT,
+    REPLAY_CREATE,
+    REPLAY_SET,
+    REPLAY_DESTROY
+};
+
+/**
+ * @brief Reads a LEB128 variable-length integer written by putVarint().
+ * 
+ * @param data The buffer.
+ * @param length The buffer size in bytes.
+ * @param position The read position, advanced past the integer.
+ * @return The value.
+ * @throw std::invalid_argument If the integer runs past the end of the buffer.
+ */
+inline uint64_t getVarint(const uint8_t *data, size_t length, size_t &position) {
+    uint64_t value = 0;
+    for (int shift = 0; position < length && shift < 64; shift += 7) {
+        uint8_t byte = data[position++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+    throw invalid_argument("Replay is truncated.");
+}
+
+/**
+ * @class ReplayRecorder
+ * @brief Records every character-affecting operation of a world in a compact binary replay.
+ * 
+ * The recorder is the journal of its world, so every change made through the store, the pool
+ * or a pooled GameCharacter is recorded. After a header with the magic string and the
+ * world's node and epoch, every operation is an opcode byte followed by varints, all starting
+ * with the character ID: spawns of store rows and creations of pooled objects carry the name
+ * and the attributes, renames the name, damage the amount and bulk updates the new
+ * attributes. A tick marker closes every tick, and every snapshotInterval ticks the ID
+ * counter, a block-compressed migration buffer of the whole store and the pooled characters
+ * are embedded, so playback can seek without replaying from the start. Recording only
+ * appends a few bytes to a buffer.
+ */
+class ReplayRecorder : public CharacterJournal {
+public:
+    /**
+     * @brief Constructor to start an empty replay.
+     * 
+     * @param counters The counters of the recorded world; the world must be empty.
+     * @param snapshotInterval The number of ticks between embedded snapshots, or 0 for none.
+     */
+    ReplayRecorder(const CharacterCounters &counters, size_t snapshotInterval = REPLAY_SNAPSHOT_INTERVAL)
+        : buffer(REPLAY_MAGIC, REPLAY_MAGIC + 8), snapshotInterval(snapshotInterval) {
+        putVarint(buffer, counters.node);
+        putVarint(buffer, counters.epoch);
+        putVarint(buffer, counters.uniqueId);
+    }
+
+    void spawn(CharacterId id, const string &name, int health, int attackPower) override {
+        putCharacter(REPLAY_SPAWN, id, name, health, attackPower);
+    }
+
+    void create(CharacterId id, const string &name, int health, int attackPower) override {
+        putCharacter(REPLAY_CREATE, id, name, health, attackPower);
+    }
+
+    void rename(CharacterId id, const string &name) override {
+        buffer.push_back(REPLAY_RENAME);
+        putVarint(buffer, (uint64_t)id);
+        putName(name);
+    }
+
+    void damage(CharacterId id, int amount) override {
+        buffer.push_back(REPLAY_DAMAGE);
+        putVarint(buffer, (uint64_t)id);
+        putVarint(buffer, (uint32_t)amount);
+    }
+
+    void set(CharacterId id, int health, int attackPower) override {
+        buffer.push_back(REPLAY_SET);
+        putVarint(buffer, (uint64_t)id);
+        putVarint(buffer, (uint32_t)(health + 1));
+        putVarint(buffer, (uint32_t)attackPower);
+    }
+
+    void despawn(CharacterId id) override {
+        buffer.push_back(REPLAY_DESPAWN);
+        putVarint(buffer, (uint64_t)id);
+    }
+
+    void destroy(CharacterId id) override {
+        buffer.push_back(REPLAY_DESTROY);
+        putVarint(buffer, (uint64_t)id);
+    }
+
+    /**
+     * @brief Closes the current tick, embedding a snapshot when one is due.
+     * @param store The store of the recorded world.
+     * @param pool The pool of the recorded world.
+     * @param counters The counters of the recorded world.
+     */
+    void tick(const CharacterStore &store, const CharacterPool &pool, const CharacterCounters &counters) {
+        buffer.push_back(REPLAY_TICK);
+        ++ticks;
+        if (snapshotInterval != 0 && ticks % snapshotInterval == 0) {
+            vector<uint32_t> rows(store.size());
+            for (size_t row = 0; row < rows.size(); ++row) {
+                rows[row] = (uint32_t)row;
+            }
+            vector<uint8_t> snapshot = compressBlocks(store.packMigration(rows));
+            buffer.push_back(REPLAY_SNAPSHOT);
+            putVarint(buffer, ticks);
+            putVarint(buffer, counters.uniqueId);
+            putVarint(buffer, snapshot.size());
+            buffer.insert(buffer.end(), snapshot.begin(), snapshot.end());
+            putVarint(buffer, pool.size());
+            pool.forEach([&](GameCharacter &character) {
+                putVarint(buffer, (uint64_t)character.id);
+                putName(character.name);
+                putVarint(buffer, (uint32_t)(character.health + 1));
+                putVarint(buffer, (uint32_t)character.attackPower);
+            });
+        }
+    }
+
+    /**
+     * @brief Gets the replay recorded so far.
+     * @return The replay bytes.
+     */
+    const vector<uint8_t> &data() const {
+        return buffer;
+    }
+
+    uint64_t tickCount() const {
+        return ticks;
+    }
+
+private:
+    vector<uint8_t> buffer;
+    size_t snapshotInterval;
+    uint64_t ticks = 0;
+
+    void putName(const string &name) {
+        putVarint(buffer, name.size());
+        buffer.insert(buffer.end(), name.begin(), name.end());
+    }
+
+    void putCharacter(ReplayOperation operation, CharacterId id, const string &name, int health, int attackPower) {
+        buffer.push_back(operation);
+        putVarint(buffer, (uint64_t)id);
+        putName(name);
+        putVarint(buffer, (uint32_t)(health + 1));
+        putVarint(buffer, (uint32_t)attackPower);
+    }
+};
+
+class CharacterWorld;
+
+/**
+ * @class ReplayPlayer
+ * @brief Plays a replay back into a world at full speed, with seeking through embedded snapshots.
+ */
+class ReplayPlayer {
+public:
+    /**
+     * @brief Constructor to open a replay and index its snapshots.
+     * @param replay The replay bytes; they must outlive the player.
+     * @throw std::invalid_argument If the bytes are not a replay.
+     */
+    ReplayPlayer(const vector<uint8_t> &replay);
+
+    /**
+     * @brief Plays the operations of the next tick.
+     * @param world The world to apply them to.
+     * @return False if the replay has ended.
+     * @throw std::invalid_argument If the replay is corrupt or does not match the world.
+     */
+    bool step(CharacterWorld &world);
+
+    /**
+     * @brief Plays every remaining tick.
+     * @param world The world to apply them to.
+     * @return The number of operations played.
+     */
+    size_t playAll(CharacterWorld &world);
+
+    /**
+     * @brief Moves the world to the state after a given tick.
+     * 
+     * The world is rebuilt from the last snapshot at or before the tick, or from the start,
+     * and the ticks after it are played.
+     * 
+     * @param world The world to rebuild; its characters are replaced.
+     * @param target The number of completed ticks to seek to.
+     * @throw std::invalid_argument If the replay is corrupt or shorter than the target.
+     */
+    void seek(CharacterWorld &world, uint64_t target);
+
+    /**
+     * @brief Gets the number of ticks played so far.
+     * @return The current tick.
+     */
+    uint64_t tick() const {
+        return ticks;
+    }
+
+private:
+    struct Snapshot {
+        uint64_t tick;
+        size_t offset;
+    };
+
+    const vector<uint8_t> &replay;
+    size_t start;
+    int64_t initialIds;
+    size_t position;
+    uint64_t ticks = 0;
+    size_t operations = 0;
+    vector<Snapshot> snapshots;
+
+    string readName(size_t &at) const;
+    void skip(size_t &at, uint8_t operation) const;
+    void restore(CharacterWorld &world, size_t at, int64_t idCount) const;
+};
+
+/**
+ * @class CharacterWorld
+ * @brief An independent world of characters with its own IDs, object count, storage and indexes.
+ * 
+ * Every world, e.g. one per hosted match, owns its counters, a column store with its handle
+ * tables and ID registry, and a pool for GameCharacter objects. Worlds share no state, so
+ * different worlds can run on different threads without synchronization. The default world
+ * uses the static counters of GameCharacter, which keeps the static API working unchanged.
+ */
+class CharacterWorld {
+private:
+    CharacterCounters ownCounters;
+
+public:
+    CharacterCounters &counters;
+    CharacterStore store;
+    CharacterPool pool;
+
+    /**
+     * @brief Constructor to create an empty world.
+     * 
+     * @param node The node (process) the world runs on, part of every ID it creates.
+     * @param epoch The epoch of the node, part of every ID the world creates.
+     * @throw std::invalid_argument If node or epoch does not fit into a character ID.
+     */
+    CharacterWorld(uint32_t node = 0, uint32_t epoch = 0) : counters(ownCounters), store(ownCounters), pool(ownCounters) {
+        composeCharacterId(node, epoch, false, 0);
+        counters.node = node;
+        counters.epoch = epoch;
+    }
+
+    CharacterWorld(const CharacterWorld &) = delete;
+    CharacterWorld &operator=(const CharacterWorld &) = delete;
+
+    /**
+     * @brief Gets the world that GameCharacter's static counters belong to.
+     * @return The default world.
+     */
+    static CharacterWorld &defaultWorld() {
+        static CharacterWorld world(GameCharacter::defaultCounters);
+        return world;
+    }
+
+    /**
+     * @brief Starts or stops recording every change of the world's characters.
+     * @param replay The recorder to journal to, or null to stop recording.
+     */
+    void record(ReplayRecorder *replay) {
+        recorder = replay;
+        counters.journal = replay;
+    }
+
+    /**
+     * @brief Gets the recorder of the world.
+     * @return The recorder, or null when not recording.
+     */
+    ReplayRecorder *getRecorder() const {
+        return recorder;
+    }
+
+    /**
+     * @brief Adds a character to the world's column store.
+     * 
+     * @param name The name of the character.
+     * @param health The health points of the character (positive value or -1 for invincible).
+     * @param attackPower The attack power of the character.
+     * @return The handle of the character in the store.
+     * @throw std::invalid_argument If name, health, or attack power is invalid.
+     */
+    CharacterHandle spawn(string name, int health, int attackPower) {
+        return store.add(name, health, attackPower);
+    }
+
+    /**
+     * @brief Adds a character with an ID minted beforehand, e.g. by an IdMinter of the world.
+     * 
+     * @param name The name of the character.
+     * @param health The health points of the character (positive value or -1 for invincible).
+     * @param attackPower The attack power of the character.
+     * @param id The unique ID of the character.
+     * @return The handle of the character in the store.
+     * @throw std::invalid_argument If an attribute is invalid or the ID is already stored.
+     */
+    CharacterHandle spawn(string name, int health, int attackPower, CharacterId id) {
+        return store.add(name, health, attackPower, id);
+    }
+
+    /**
+     * @brief Renames a character of the world's column store.
+     * 
+     * @param handle The handle of the character.
+     * @param name The new name.
+     * @throw std::invalid_argument If the name is invalid or the character has been despawned.
+     */
+    void rename(CharacterHandle handle, const string &name) {
+        store.rename(handle, name);
+    }
+
+    /**
+     * @brief Deals damage to a character of the world's column store.
+     * 
+     * Invincible characters are not affected, and health does not drop below 0.
+     * 
+     * @param handle The handle of the character.
+     * @param amount The damage, not negative.
+     * @throw std::invalid_argument If the character has been despawned.
+     */
+    void damage(CharacterHandle handle, int amount) {
+        store.damage(handle, amount);
+    }
+
+    /**
+     * @brief Deals damage to many characters of the world's column store through the bound damage kernel.
+     * 
+     * @param targets The handles of the characters, each at most once.
+     * @param amounts The damage of each target, not negative.
+     * @throw std::invalid_argument If the sizes differ, an amount is negative or a character
+     *                              is despawned.
+     */
+    void damage(const vector<CharacterHandle> &targets, const vector<int> &amounts) {
+        store.damage(targets, amounts);
+    }
+
+    /**
+     * @brief Adds a hook called with the handle of every character right before it is despawned.
+     * 
+     * Indexes kept outside the store, e.g. a SpatialGrid, use it to drop the character.
+     * 
+     * @param hook The hook, called in the order added.
+     */
+    void onDespawn(function<void(CharacterHandle)> hook) {
+        despawnHooks.push_back(move(hook));
+    }
+
+    /**
+     * @brief Removes every character of the world's column store whose bit is set in a death bitmap.
+     * 
+     * @param deathBitmap One bit per row, as produced by CharacterStore::filter().
+     * @return The number of despawned characters.
+     */
+    size_t despawn(const vector<uint64_t> &deathBitmap) {
+        if (!despawnHooks.empty()) {
+            for (size_t word = 0; word < deathBitmap.size() && word * 64 < store.size(); ++word) {
+                for (uint64_t bits = deathBitmap[word]; bits != 0; bits &= bits - 1) {
+                    size_t row = word * 64 + __builtin_ctzll(bits);
+                    if (row >= store.size()) {
+                        break;
+                    }
+                    for (function<void(CharacterHandle)> &hook : despawnHooks) {
+                        hook(store.handleAt(row));
+                    }
+                }
+            }
+        }
+        return store.despawn(deathBitmap);
+    }
+
+    /**
+     * @brief Removes a single character from the world's column store.
+     * @param handle The handle of the character.
+     * @throw std::invalid_argument If the character has already been despawned.
+     */
+    void despawn(CharacterHandle handle) {
+        size_t row = store.rowOf(handle);
+        vector<uint64_t> bitmap(row / 64 + 1);
+        bitmap[row / 64] = 1ULL << (row % 64);
+        despawn(bitmap);
+    }
+
+    /**
+     * @brief Ends the current tick of the replay being recorded, if any.
+     */
+    void endTick() {
+        if (recorder != nullptr) {
+            recorder->tick(store, pool, counters);
+        }
+    }
+
+    /**
+     * @brief Creates a GameCharacter object in the world's pool.
+     * 
+     * @param name The name of the character.
+     * @param health The health points of the character (positive value or -1 for invincible).
+     * @param attackPower The attack power of the character.
+     * @return The handle of the character in the pool.
+     * @throw std::invalid_argument If name, health, or attack power is invalid.
+     */
+    CharacterHandle create(string name, int health, int attackPower) {
+        return pool.create(name, health, attackPower);
+    }
+
+    /**
+     * @brief Gets the number of live characters in this world.
+     * @return The object count of the world.
+     */
+    int getObjectCount() const {
+        return counters.objectCount;
+    }
+
+    /**
+     * @brief Gets the number of characters ever created in this world.
+     * @return The number of IDs handed out.
+     */
+    int64_t getIdCount() const {
+        return counters.uniqueId;
+    }
+
+    /**
+     * @brief Gets the order-independent checksum of the world's characters.
+     * 
+     * It covers GameCharacter objects, pooled characters and the rows of every store of the
+     * world. The checksum is kept up to date in O(1) by every change of a character, so
+     * lockstep peers can compare it every tick.
+     * 
+     * @return The checksum.
+     */
+    uint64_t checksum() const {
+        return counters.checksum;
+    }
+
+    /**
+     * @brief Recomputes the checksum from the characters in the pool and the store and compares it.
+     * 
+     * Characters that bypassed the setters, e.g. by writing the public fields or columns, or
+     * that live outside the pool and the store make the comparison fail.
+     * 
+     * @return True if the incremental checksum matches the recomputed one.
+     */
+    bool verifyChecksum() const {
+        uint64_t recomputed = store.recomputeChecksum();
+        pool.forEach([&](GameCharacter &character) {
+            recomputed += characterHash(character.getPersonalId(), character.getName(), character.getHealth(),
+                                        character.getAttackPower());
+        });
+        return recomputed == counters.checksum;
+    }
+
+private:
+    ReplayRecorder *recorder = nullptr;
+    vector<function<void(CharacterHandle)>> despawnHooks;
+
+    CharacterWorld(CharacterCounters &shared) : counters(shared), store(shared), pool(shared) {}
+};
+
+ReplayPlayer::ReplayPlayer(const vector<uint8_t> &replay) : replay(replay) {
+    if (replay.size() < 8 || memcmp(replay.data(), REPLAY_MAGIC, 8) != 0) {
+        throw invalid_argument("Not a character replay.");
+    }
+    size_t at = 8;
+    getVarint(replay.data(), replay.size(), at);
+    getVarint(replay.data(), replay.size(), at);
+    initialIds = (int64_t)getVarint(replay.data(), replay.size(), at);
+    start = position = at;
+    while (at < replay.size()) {
+        uint8_t operation = replay[at++];
+        if (operation == REPLAY_SNAPSHOT) {
+            size_t offset = at;
+            snapshots.push_back(Snapshot{getVarint(replay.data(), replay.size(), offset), at});
+        }
+        skip(at, operation);
+    }
+}
+
+string ReplayPlayer::readName(size_t &at) const {
+    size_t length = getVarint(replay.data(), replay.size(), at);
+    if (length > replay.size() - at) {
+        throw invalid_argument("Replay is truncated.");
+    }
+    at += length;
+    return string((const char *)replay.data() + at - length, length);
+}
+
+void ReplayPlayer::skip(size_t &at, uint8_t operation) const {
+    const uint8_t *data = replay.data();
+    size_t size = replay.size();
+    switch (operation) {
+    case REPLAY_TICK:
+        break;
+    case REPLAY_SPAWN:
+    case REPLAY_CREATE:
+        getVarint(data, size, at);
+        readName(at);
+        getVarint(data, size, at);
+        getVarint(data, size, at);
+        break;
+    case REPLAY_SET:
+        getVarint(data, size, at);
+        getVarint(data, size, at);
+        getVarint(data, size, at);
+        break;
+    case REPLAY_RENAME:
+        getVarint(data, size, at);
+        readName(at);
+        break;
+    case REPLAY_DAMAGE:
+        getVarint(data, size, at);
+        getVarint(data, size, at);
+        break;
+    case REPLAY_DESPAWN:
+    case REPLAY_DESTROY:
+        getVarint(data, size, at);
+        break;
+    case REPLAY_SNAPSHOT:
+        getVarint(data, size, at);
+        getVarint(data, size, at);
+        readName(at);
+        for (uint64_t pooled = getVarint(data, size, at); pooled != 0; --pooled) {
+            skip(at, REPLAY_SPAWN);
+        }
+        break;
+    default:
+        throw invalid_argument("Unknown replay operation " + to_string(operation) + ".");
+    }
+}
+
+bool ReplayPlayer::step(CharacterWorld &world) {
+    const uint8_t *data = replay.data();
+    size_t size = replay.size();
+    if (position >= size) {
+        return false;
+    }
+    while (position < size) {
+        uint8_t operation = data[position++];
+        if (operation == REPLAY_TICK) {
+            ++ticks;
+            break;
+        }
+        if (operation == REPLAY_SNAPSHOT) {
+            skip(position, operation);
+            continue;
+        }
+        ++operations;
+        CharacterId id = (CharacterId)getVarint(data, size, position);
+        if (operation == REPLAY_SPAWN || operation == REPLAY_CREATE) {
+            string name = readName(position);
+            int health = (int)getVarint(data, size, position) - 1;
+            int attackPower = (int)getVarint(data, size, position);
+            if (operation == REPLAY_SPAWN) {
+                world.counters.reserve(id);
+                world.store.add(name, health, attackPower, id);
+            } else {
+                world.pool.create(name, health, attackPower, id);
+            }
+        } else if (operation == REPLAY_DESTROY) {
+            world.pool.destroy(world.pool.find(id));
+        } else if (operation == REPLAY_RENAME && world.store.has(id)) {
+            world.store.rename(world.store.find(id), readName(position));
+        } else if (operation == REPLAY_RENAME) {
+            world.pool.get(world.pool.find(id)).setName(readName(position));
+        } else if (operation == REPLAY_DAMAGE) {
+            world.store.damage(world.store.find(id), (int)getVarint(data, size, position));
+        } else if (operation == REPLAY_SET) {
+            int health = (int)getVarint(data, size, position) - 1;
+            int attackPower = (int)getVarint(data, size, position);
+            world.store.set(world.store.find(id), health, attackPower);
+        } else if (operation == REPLAY_DESPAWN) {
+            world.despawn(world.store.find(id));
+        } else {
+            throw invalid_argument("Unknown replay operation " + to_string(operation) + ".");
+        }
+    }
+    return true;
+}
+
+size_t ReplayPlayer::playAll(CharacterWorld &world) {
+    size_t before = operations;
+    while (step(world)) {
+    }
+    return operations - before;
+}
+
+void ReplayPlayer::restore(CharacterWorld &world, size_t at, int64_t idCount) const {
+    const uint8_t *data = replay.data();
+    size_t size = replay.size();
+    world.despawn(vector<uint64_t>((world.store.size() + 63) / 64, ~0ULL));
+    vector<CharacterId> pooled;
+    world.pool.forEach([&](GameCharacter &character) {
+        pooled.push_back(character.id);
+    });
+    for (CharacterId id : pooled) {
+        world.pool.destroy(world.pool.find(id));
+    }
+    if (at != 0) {
+        size_t length = getVarint(data, size, at);
+        if (length > size - at) {
+            throw invalid_argument("Replay is truncated.");
+        }
+        vector<uint8_t> packed(replay.begin() + at, replay.begin() + at + length);
+        world.store.installMigration(CompressedBlocks(packed).decompressAll(), RESTORE_IDS);
+        at += length;
+        for (uint64_t count = getVarint(data, size, at); count != 0; --count) {
+            CharacterId id = (CharacterId)getVarint(data, size, at);
+            string name = readName(at);
+            int health = (int)getVarint(data, size, at) - 1;
+            int attackPower = (int)getVarint(data, size, at);
+            world.pool.create(name, health, attackPower, id);
+        }
+    }
+    if (idCount > 0) {
+        world.counters.reserve(composeCharacterId(world.counters.node, world.counters.epoch, false, idCount - 1));
+    }
+}
+
+void ReplayPlayer::seek(CharacterWorld &world, uint64_t target) {
+    ReplayRecorder *recorder = world.getRecorder();
+    world.record(nullptr);
+    position = start;
+    ticks = 0;
+    int64_t idCount = initialIds;
+    size_t snapshot = 0;
+    for (const Snapshot &candidate : snapshots) {
+        if (candidate.tick <= target) {
+            size_t at = candidate.offset;
+            ticks = getVarint(replay.data(), replay.size(), at);
+            idCount = (int64_t)getVarint(replay.data(), replay.size(), at);
+            snapshot = at;
+            position = candidate.offset;
+            skip(position, REPLAY_SNAPSHOT);
+        }
+    }
+    restore(world, snapshot, idCount);
+    while (ticks < target) {
+        if (!step(world)) {
+            world.record(recorder);
+            throw invalid_argument("Replay ends at tick " + to_string(ticks) + ".");
+        }
+    }
+    world.record(recorder);
+}
+
+#define IMPORT_CLOCK_INTERVAL 64
+#define IMPORT_MAX_ERRORS 100
+
+/**
+ * @brief Progress of an ImportJob.
+ */
+struct ImportProgress {
+    size_t imported;
+    size_t rejected;
+    size_t bytesRead;
+    size_t totalBytes;
+    bool finished;
+
+    double fraction() const {
+        return totalBytes == 0 ? 1.0 : (double)bytesRead / totalBytes;
+    }
+};
+
+/**
+ * @class ImportJob
+ * @brief Imports a roster into a world in resumable slices that each fit a time budget.
+ * 
+ * The roster has one character per line as "name,health,attackPower". Every call to run()
+ * parses, validates and adds records until its budget is spent, checking the clock only every
+ * IMPORT_CLOCK_INTERVAL records, and returns with the parse position kept for the next tick.
+ * IDs come from the job's own IdMinter, whose reserved block also carries over between
+ * slices, and characters are spawned through the world, so a recording replay and the world
+ * checksum see every imported character. After the first slice the store reserves room for
+ * the estimated remaining records, so later slices do not stall on reallocation. Invalid
+ * records are skipped and reported by line; past IMPORT_MAX_ERRORS they are only counted.
+ */
+class ImportJob {
+public:
+    /**
+     * @brief Constructor to prepare an import; nothing is imported until run() is called.
+     * 
+     * @param world The world to import into.
+     * @param roster The roster text; it must outlive the job.
+     */
+    ImportJob(CharacterWorld &world, const string &roster) : world(world), roster(roster), minter(world.counters) {}
+
+    /**
+     * @brief Imports records until the budget is spent or the roster ends.
+     * @param budget The time available in this slice.
+     * @return The progress after this slice.
+     */
+    ImportProgress run(chrono::microseconds budget) {
+        auto deadline = chrono::steady_clock::now() + budget;
+        if (!reserved && line > 0) {
+            reserved = true;
+            world.store.reserve(world.store.size() + (roster.size() - position) * line / position + 1);
+        }
+        for (size_t records = 1; position < roster.size(); ++records) {
+            importLine();
+            if (records % IMPORT_CLOCK_INTERVAL == 0 && chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+        }
+        return progress();
+    }
+
+    /**
+     * @brief Gets the progress so far.
+     * @return The progress.
+     */
+    ImportProgress progress() const {
+        return ImportProgress{imported, rejected, position, roster.size(), position >= roster.size()};
+    }
+
+    /**
+     * @brief Gets the messages of the first IMPORT_MAX_ERRORS rejected records.
+     * @return Messages of the form "line N: reason".
+     */
+    const vector<string> &errors() const {
+        return messages;
+    }
+
+private:
+    CharacterWorld &world;
+    const string &roster;
+    IdMinter minter;
+    size_t position = 0;
+    size_t line = 0;
+    size_t imported = 0;
+    size_t rejected = 0;
+    bool reserved = false;
+    vector<string> messages;
+
+    static bool parseNumber(const char *begin, const char *end, int &value) {
+        bool negative = begin < end && *begin == '-';
+        begin += negative;
+        if (begin == end || end - begin > 9) {
+            return false;
+        }
+        value = 0;
+        for (; begin < end; ++begin) {
+            if (*begin < '0' || *begin > '9') {
+                return false;
+            }
+            value = value * 10 + (*begin - '0');
+        }
+        value = negative ? -value : value;
+        return true;
+    }
+
+    void importLine() {
+        const char *data = roster.data();
+        const char *begin = data + position;
+        const char *end = (const char *)memchr(begin, '\n', roster.size() - position);
+        end = end == nullptr ? data + roster.size() : end;
+        position = min(roster.size(), (size_t)(end - data) + 1);
+        ++line;
+        if (end > begin && end[-1] == '\r') {
+            --end;
+        }
+        if (begin == end) {
+            return;
+        }
+        const char *first = (const char *)memchr(begin, ',', end - begin);
+        const char *second = first == nullptr ? nullptr : (const char *)memchr(first + 1, ',', end - first - 1);
+        int health, attackPower;
+        if (second == nullptr || !parseNumber(first + 1, second, health) || !parseNumber(second + 1, end, attackPower)) {
+            reject("Expected name,health,attackPower.");
+            return;
+        }
+        string name(begin, first);
+        bool valid = NameDfa::check(name) == NAME_VALID && (health > 0 || health == -1) && health <= MAX_HEALTH
+                     && attackPower <= MAX_POWER;
+        if (!valid && messages.size() >= IMPORT_MAX_ERRORS) {
+            ++rejected;
+            return;
+        }
+        try {
+            world.spawn(name, health, attackPower, minter.mint());
+            ++imported;
+        } catch (invalid_argument &e) {
+            reject(e.what());
+        }
+    }
+
+    void reject(const string &reason) {
+        ++rejected;
+        if (messages.size() < IMPORT_MAX_ERRORS) {
+            messages.push_back("line " + to_string(line) + ": " + reason);
+        }
+    }
+};
+
+#define MVCC_CHUNK 4096
+#define MVCC_READERS 64
+#define MVCC_FREE_SLOT UINT64_MAX
+
+static_assert(MVCC_CHUNK % STORE_CHANGE_CHUNK == 0, "Versioned chunks must cover whole change chunks.");
+
+/**
+ * @class VersionedColumns
+ * @brief Multi-version copy of the numeric character columns for long scans beside a writer.
+ * 
+ * Rows are kept in chunks of MVCC_CHUNK. The first write to a chunk in an epoch copies it into
+ * a new version, and later writes of that epoch change the copy in place; commit() makes the
+ * epoch visible. Readers pin the last committed epoch and follow each chunk's version chain
+ * to the newest version not newer than it, so a scan sees one consistent state and never
+ * blocks the writer. After each commit the writer frees the versions that no pinned reader
+ * can reach any more. Only one thread may write; any number of threads, up to MVCC_READERS
+ * at a time, may read. The columns are usually kept as the versioned copy of a CharacterStore
+ * by calling sync() before every commit, which copies only the chunks the store changed.
+ */
+class VersionedColumns {
+private:
+    struct Version {
+        uint64_t epoch;
+        size_t rows;
+        atomic<Version *> older;
+        int health[MVCC_CHUNK];
+        int attackPower[MVCC_CHUNK];
+        CharacterId ids[MVCC_CHUNK];
+    };
+
+public:
+    /**
+     * @class ReadView
+     * @brief A consistent view of the columns at a pinned epoch.
+     * 
+     * The epoch stays pinned, and its versions alive, until the view is destroyed.
+     */
+    class ReadView {
+    public:
+        ReadView(ReadView &&other) : owner(other.owner), slot(other.slot), pinned(other.pinned), rows(other.rows) {
+            other.owner = nullptr;
+        }
+
+        ReadView(const ReadView &) = delete;
+        ReadView &operator=(const ReadView &) = delete;
+
+        ~ReadView() {
+            if (owner != nullptr) {
+                owner->slots[slot].store(MVCC_FREE_SLOT);
+            }
+        }
+
+        uint64_t epoch() const {
+            return pinned;
+        }
+
+        size_t size() const {
+            return rows;
+        }
+
+        /**
+         * @brief Calls a function with the visible version of every chunk.
+         * @param function Called as function(firstRow, rows, health, attackPower, ids).
+         */
+        template <class Function>
+        void forEachChunk(Function function) const {
+            for (size_t chunk = 0; chunk * MVCC_CHUNK < rows; ++chunk) {
+                const Version *version = owner->visible(chunk, pinned);
+                function(chunk * MVCC_CHUNK, version->rows, version->health, version->attackPower, version->ids);
+            }
+        }
+
+        int getHealth(size_t row) const {
+            return owner->visible(row / MVCC_CHUNK, pinned)->health[row % MVCC_CHUNK];
+        }
+
+        int getAttackPower(size_t row) const {
+            return owner->visible(row / MVCC_CHUNK, pinned)->attackPower[row % MVCC_CHUNK];
+        }
+
+        CharacterId getPersonalId(size_t row) const {
+            return owner->visible(row / MVCC_CHUNK, pinned)->ids[row % MVCC_CHUNK];
+        }
+
+    private:
+        const VersionedColumns *owner;
+        size_t slot;
+        uint64_t pinned;
+        size_t rows;
+
+        ReadView(const VersionedColumns *owner, size_t slot, uint64_t pinned)
+            : owner(owner), slot(slot), pinned(pinned), rows(0) {
+            for (size_t chunk = 0; chunk < owner->heads.size(); ++chunk) {
+                const Version *version = owner->visible(chunk, pinned);
+                if (version == nullptr) {
+                    break;
+                }
+                rows += version->rows;
+            }
+        }
+
+        friend class VersionedColumns;
+    };
+
+    /**
+     * @brief Constructor to create empty columns.
+     * @param capacity The maximum number of rows.
+     */
+    VersionedColumns(size_t capacity) : heads((capacity + MVCC_CHUNK - 1) / MVCC_CHUNK), pruned(heads.size()) {
+        for (atomic<uint64_t> &slot : slots) {
+            slot.store(MVCC_FREE_SLOT);
+        }
+    }
+
+    VersionedColumns(const VersionedColumns &) = delete;
+    VersionedColumns &operator=(const VersionedColumns &) = delete;
+
+    /**
+     * @brief Destructor to free every version; no view may outlive the columns.
+     */
+    ~VersionedColumns() {
+        for (atomic<Version *> &head : heads) {
+            release(head.load());
+        }
+    }
+
+    /**
+     * @brief Appends a row; visible to readers after the next commit.
+     * 
+     * @param id The unique ID of the character.
+     * @param health The health points of the character.
+     * @param attackPower The attack power of the character.
+     * @return The new row.
+     * @throw std::invalid_argument If the capacity is exhausted.
+     */
+    size_t append(CharacterId id, int health, int attackPower) {
+        if (rows == heads.size() * MVCC_CHUNK) {
+            throw invalid_argument("Versioned columns are full.");
+        }
+        size_t row = rows++;
+        Version *version = writable(row / MVCC_CHUNK);
+        version->ids[row % MVCC_CHUNK] = id;
+        version->health[row % MVCC_CHUNK] = health;
+        version->attackPower[row % MVCC_CHUNK] = attackPower;
+        version->rows = row % MVCC_CHUNK + 1;
+        return row;
+    }
+
+    void setHealth(size_t row, int value) {
+        writable(row / MVCC_CHUNK)->health[row % MVCC_CHUNK] = value;
+    }
+
+    void setAttackPower(size_t row, int value) {
+        writable(row / MVCC_CHUNK)->attackPower[row % MVCC_CHUNK] = value;
+    }
+
+    /**
+     * @brief Removes a row by moving the last row into its place.
+     * @param row The row to remove.
+     */
+    void swapRemove(size_t row) {
+        size_t last = --rows;
+        if (row != last) {
+            const Version *tail = writable(last / MVCC_CHUNK);
+            Version *hole = writable(row / MVCC_CHUNK);
+            hole->ids[row % MVCC_CHUNK] = tail->ids[last % MVCC_CHUNK];
+            hole->health[row % MVCC_CHUNK] = tail->health[last % MVCC_CHUNK];
+            hole->attackPower[row % MVCC_CHUNK] = tail->attackPower[last % MVCC_CHUNK];
+        }
+        writable(last / MVCC_CHUNK)->rows = last % MVCC_CHUNK;
+    }
+
+    /**
+     * @brief Copies the changes of a store since the last sync; visible to readers after the next commit.
+     * 
+     * Only the chunks that the store's mutators marked as changed, or whose row count changed,
+     * get a new version, so a tick that touches few chunks costs few copies. The columns must
+     * only be written through sync() of one store.
+     * 
+     * @param store The store the columns are a copy of.
+     * @return The number of chunks copied.
+     * @throw std::invalid_argument If the store has more rows than the capacity.
+     */
+    size_t sync(const CharacterStore &store) {
+        if (store.size() > heads.size() * MVCC_CHUNK) {
+            throw invalid_argument("Versioned columns are full.");
+        }
+        const vector<uint64_t> &chunkChanges = store.getChunkChanges();
+        size_t copied = 0;
+        for (size_t begin = 0; begin < max(rows, store.size()); begin += MVCC_CHUNK) {
+            size_t count = store.size() > begin ? min((size_t)MVCC_CHUNK, store.size() - begin) : 0;
+            bool changed = count != (rows > begin ? min((size_t)MVCC_CHUNK, rows - begin) : 0);
+            for (size_t row = begin; !changed && row < begin + count; row += STORE_CHANGE_CHUNK) {
+                changed = chunkChanges[row / STORE_CHANGE_CHUNK] > synced;
+            }
+            if (changed) {
+                Version *version = writable(begin / MVCC_CHUNK);
+                memcpy(version->health, store.health.data() + begin, count * sizeof(int));
+                memcpy(version->attackPower, store.attackPower.data() + begin, count * sizeof(int));
+                memcpy(version->ids, store.ids.data() + begin, count * sizeof(CharacterId));
+                version->rows = count;
+                ++copied;
+            }
+        }
+        rows = store.size();
+        synced = store.getChangeCount();
+        return copied;
+    }
+
+    /**
+     * @brief Makes the writes so far visible to new readers and frees unreachable versions.
+     * @return The committed epoch.
+     */
+    uint64_t commit() {
+        committed.store(writeEpoch);
+        ++writeEpoch;
+        collect();
+        return committed.load();
+    }
+
+    /**
+     * @brief Pins the last committed epoch for reading; may be called from any thread.
+     * @return The view of the pinned epoch.
+     * @throw std::runtime_error If MVCC_READERS views are already pinned.
+     */
+    ReadView pin() const {
+        uint64_t epoch = committed.load();
+        for (size_t slot = 0; slot < MVCC_READERS; ++slot) {
+            uint64_t free = MVCC_FREE_SLOT;
+            if (slots[slot].compare_exchange_strong(free, epoch)) {
+                for (uint64_t now = committed.load(); now != epoch; now = committed.load()) {
+                    epoch = now;
+                    slots[slot].store(epoch);
+                }
+                return ReadView(this, slot, epoch);
+            }
+        }
+        throw runtime_error("Too many pinned readers.");
+    }
+
+    /**
+     * @brief Gets the number of rows written so far, committed or not.
+     * @return The row count.
+     */
+    size_t size() const {
+        return rows;
+    }
+
+    /**
+     * @brief Gets the number of chunk versions currently allocated.
+     * @return The version count.
+     */
+    size_t versionCount() const {
+        return versions;
+    }
+
+private:
+    vector<atomic<Version *>> heads;
+    vector<bool> pruned;
+    vector<size_t> chains;
+    mutable atomic<uint64_t> slots[MVCC_READERS];
+    atomic<uint64_t> committed{0};
+    uint64_t writeEpoch = 1;
+    size_t rows = 0;
+    size_t versions = 0;
+    uint64_t synced = 0;
+
+    const Version *visible(size_t chunk, uint64_t epoch) const {
+        const Version *version = heads[chunk].load(memory_order_acquire);
+        while (version != nullptr && version->epoch > epoch) {
+            version = version->older.load(memory_order_acquire);
+        }
+        return version;
+    }
+
+    Version *writable(size_t chunk) {
+        Version *head = heads[chunk].load(memory_order_relaxed);
+        if (head != nullptr && head->epoch == writeEpoch) {
+            return head;
+        }
+        Version *fresh = new Version;
+        fresh->epoch = writeEpoch;
+        fresh->rows = head == nullptr ? 0 : head->rows;
+        fresh->older.store(head, memory_order_relaxed);
+        if (head != nullptr) {
+            memcpy(fresh->health, head->health, head->rows * sizeof(int));
+            memcpy(fresh->attackPower, head->attackPower, head->rows * sizeof(int));
+            memcpy(fresh->ids, head->ids, head->rows * sizeof(CharacterId));
+            if (!pruned[chunk]) {
+                pruned[chunk] = true;
+                chains.push_back(chunk);
+            }
+        }
+        heads[chunk].store(fresh, memory_order_release);
+        ++versions;
+        return fresh;
+    }
+
+    void collect() {
+        uint64_t oldest = committed.load();
+        for (const atomic<uint64_t> &slot : slots) {
+            oldest = min(oldest, slot.load());
+        }
+        size_t kept = 0;
+        for (size_t chunk : chains) {
+            Version *version = heads[chunk].load(memory_order_relaxed);
+            while (version != nullptr && version->epoch > oldest) {
+                version = version->older.load(memory_order_relaxed);
+            }
+            if (version != nullptr) {
+                release(version->older.exchange(nullptr));
+            }
+            if (heads[chunk].load(memory_order_relaxed)->older.load(memory_order_relaxed) != nullptr) {
+                chains[kept++] = chunk;
+            } else {
+                pruned[chunk] = false;
+            }
+        }
+        chains.resize(kept);
+    }
+
+    void release(Version *version) {
+        while (version != nullptr) {
+            Version *older = version->older.load(memory_order_relaxed);
+            delete version;
+            --versions;
+            version = older;
+        }
+    }
+};
+
+#define SNAPSHOT_CHUNK 4096
+
+static_assert(SNAPSHOT_CHUNK % STORE_CHANGE_CHUNK == 0, "Snapshot chunks must cover whole change chunks.");
+
+/**
+ * @brief An immutable chunk of a population snapshot.
+ * 
+ * Names are packed into one buffer with start offsets, so a chunk is a handful of
+ * allocations however many characters it holds.
+ */
+struct SnapshotChunk {
+    vector<int> health;
+    vector<int> attackPower;
+    vector<CharacterId> ids;
+    vector<uint32_t> nameOffsets;
+    string names;
+
+    size_t size() const {
+        return ids.size();
+    }
+
+    string getName(size_t row) const {
+        return names.substr(nameOffsets[row], nameOffsets[row + 1] - nameOffsets[row]);
+    }
+};
+
+/**
+ * @class PopulationSnapshot
+ * @brief An immutable, read-optimized copy of a store at the end of a tick.
+ * 
+ * Snapshots share unchanged chunks with their predecessors. A snapshot is freed when the
+ * publisher and the last reader have dropped it.
+ */
+class PopulationSnapshot {
+public:
+    uint64_t tick;
+    vector<shared_ptr<const SnapshotChunk>> chunks;
+
+    size_t size() const {
+        return rows;
+    }
+
+    const SnapshotChunk &chunk(size_t row) const {
+        return *chunks[row / SNAPSHOT_CHUNK];
+    }
+
+    int getHealth(size_t row) const {
+        return chunk(row).health[row % SNAPSHOT_CHUNK];
+    }
+
+    int getAttackPower(size_t row) const {
+        return chunk(row).attackPower[row % SNAPSHOT_CHUNK];
+    }
+
+    CharacterId getPersonalId(size_t row) const {
+        return chunk(row).ids[row % SNAPSHOT_CHUNK];
+    }
+
+    string getName(size_t row) const {
+        return chunk(row).getName(row % SNAPSHOT_CHUNK);
+    }
+
+private:
+    size_t rows = 0;
+
+    friend class SnapshotPublisher;
+};
+
+/**
+ * @class SnapshotPublisher
+ * @brief Publishes population snapshots of a store for readers on other threads.
+ * 
+ * At the end of every interval ticks the simulation thread rebuilds, in parallel, only the
+ * chunks that the store's mutators marked as changed since the last snapshot, shares the
+ * others, and swaps the new snapshot in with one atomic pointer store. Readers take a
+ * reference with acquire() and then read it without any synchronization; the snapshot is
+ * reclaimed when its last reference is dropped.
+ */
+class SnapshotPublisher {
+public:
+    /**
+     * @brief Constructor to publish snapshots of a store.
+     * 
+     * @param store The store to publish; only the simulation thread may change it, and only
+     *              through its mutators.
+     * @param interval The number of ticks between publications.
+     * @throw std::invalid_argument If the interval is 0.
+     */
+    SnapshotPublisher(const CharacterStore &store, size_t interval = 1) : store(store), interval(interval) {
+        if (interval == 0) {
+            throw invalid_argument("Snapshot interval must be positive.");
+        }
+        publish();
+    }
+
+    /**
+     * @brief Number of threads rebuilding chunks, or 0 for the hardware concurrency.
+     */
+    unsigned workers = 0;
+
+    /**
+     * @brief Ends a tick, publishing a snapshot when one is due.
+     */
+    void endTick() {
+        if (++ticks % interval == 0) {
+            publish();
+        }
+    }
+
+    /**
+     * @brief Publishes a snapshot of the store right away.
+     * @return The number of chunks rebuilt; the others are shared with the last snapshot.
+     */
+    size_t publish() {
+        shared_ptr<const PopulationSnapshot> previous = acquire();
+        auto snapshot = make_shared<PopulationSnapshot>();
+        snapshot->tick = ticks;
+        snapshot->rows = store.size();
+        snapshot->chunks.resize((store.size() + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK);
+        atomic<size_t> rebuilt(0);
+        parallelForChunks(store.size(), SNAPSHOT_CHUNK, [&](size_t chunk, size_t begin, size_t end) {
+            if (previous && chunk < previous->chunks.size() && previous->chunks[chunk]->size() == end - begin
+                && !dirty(begin, end)) {
+                snapshot->chunks[chunk] = previous->chunks[chunk];
+            } else {
+                snapshot->chunks[chunk] = build(begin, end);
+                ++rebuilt;
+            }
+        }, workers);
+#if __cplusplus >= 202002L
+        current.store(move(snapshot));
+#else
+        atomic_store(&current, shared_ptr<const PopulationSnapshot>(move(snapshot)));
+#endif
+        rebuiltChunks += rebuilt;
+        publishedChanges = store.getChangeCount();
+        return rebuilt;
+    }
+
+    /**
+     * @brief Gets the latest snapshot; may be called from any thread.
+     * @return A reference that keeps the snapshot alive.
+     */
+    shared_ptr<const PopulationSnapshot> acquire() const {
+#if __cplusplus >= 202002L
+        return current.load();
+#else
+        return atomic_load(&current);
+#endif
+    }
+
+    /**
+     * @brief Gets the number of chunks rebuilt by all publications so far.
+     * @return The chunk count.
+     */
+    size_t getRebuiltChunks() const {
+        return rebuiltChunks;
+    }
+
+private:
+    const CharacterStore &store;
+    size_t interval;
+    uint64_t ticks = 0;
+    size_t rebuiltChunks = 0;
+    uint64_t publishedChanges = 0;
+#if __cplusplus >= 202002L
+    atomic<shared_ptr<const PopulationSnapshot>> current;
+#else
+    shared_ptr<const PopulationSnapshot> current;
+#endif
+
+    bool dirty(size_t begin, size_t end) const {
+        const vector<uint64_t> &chunkChanges = store.getChunkChanges();
+        for (size_t row = begin; row < end; row += STORE_CHANGE_CHUNK) {
+            if (chunkChanges[row / STORE_CHANGE_CHUNK] > publishedChanges) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    shared_ptr<const SnapshotChunk> build(size_t begin, size_t end) const {
+        auto chunk = make_shared<SnapshotChunk>();
+        chunk->health.assign(store.health.begin() + begin, store.health.begin() + end);
+        chunk->attackPower.assign(store.attackPower.begin() + begin, store.attackPower.begin() + end);
+        chunk->ids.assign(store.ids.begin() + begin, store.ids.begin() + end);
+        chunk->nameOffsets.reserve(end - begin + 1);
+        chunk->nameOffsets.push_back(0);
+        CharacterColumns columns = store.columns();
+        for (size_t row = begin; row < end; ++row) {
+            chunk->names += columns.name(row);
+            chunk->nameOffsets.push_back((uint32_t)chunk->names.size());
+        }
+        return chunk;
+    }
+};
+
+#define GRID_BUCKETS 65536
+#define GRID_CELL_LIMIT (1 << 30)
+
+/**
+ * @class SpatialGrid
+ * @brief Optional position component of store characters, indexed by a loose spatial hash grid.
+ * 
+ * Space is divided into square cells, and every cell is hashed into one of a fixed number of
+ * buckets, so the grid needs no bounds. Positions are kept per handle slot together with the
+ * home cell, bucket, and index inside it. The grid is loose: a character stays in its home cell
+ * until it leaves the cell by more than the looseness, and only then is swap-removed from its
+ * bucket and appended to another one, so characters wandering around a cell border cost no
+ * bucket updates. Queries widen their area by the looseness, visit the buckets of the covered
+ * cells, or every bucket once if they cover more cells than there are buckets, and filter by
+ * exact position, so hash collisions and looseness only cost time. Cell coordinates are
+ * clamped to GRID_CELL_LIMIT, so far-away positions share border cells instead of overflowing.
+ * Queries keep no state in the grid and may run concurrently with each other.
+ */
+class SpatialGrid {
+public:
+    /**
+     * @brief Constructor to create an empty grid.
+     * 
+     * @param cellSize The edge length of a cell, best about the typical query radius.
+     * @param buckets The number of hash buckets, a power of two of at most 2^32.
+     * @param looseness How far a character may leave its home cell before it is moved to another one.
+     * @throw std::invalid_argument If the number of buckets is not such a power of two.
+     */
+    SpatialGrid(float cellSize, size_t buckets = GRID_BUCKETS, float looseness = -1)
+        : cellSize(cellSize), inverseCellSize(1 / cellSize), looseness(looseness < 0 ? cellSize / 2 : looseness),
+          mask((uint32_t)(buckets - 1)) {
+        if (buckets == 0 || (buckets & (buckets - 1)) != 0 || buckets - 1 > UINT32_MAX) {
+            throw invalid_argument("Grid bucket count must be a power of two of at most 2^32.");
+        }
+        this->buckets.resize(buckets);
+    }
+
+    /**
+     * @brief Places a character or moves it to a new position.
+     * 
+     * @param handle The handle of the character in its store.
+     * @param x The new x coordinate.
+     * @param y The new y coordinate.
+     * @throw std::invalid_argument If a coordinate is not finite.
+     */
+    void place(CharacterHandle handle, float x, float y) {
+        if (!isfinite(x) || !isfinite(y)) {
+            throw invalid_argument("Character positions must be finite.");
+        }
+        if (handle.slot >= entries.size()) {
+            entries.resize(handle.slot + 1);
+        }
+        Entry &entry = entries[handle.slot];
+        if (entry.present && entry.generation != handle.generation) {
+            unlink(handle.slot);
+        }
+        if (!entry.present || !near(entry.cellX, x) || !near(entry.cellY, y)) {
+            if (entry.present) {
+                unlink(handle.slot);
+            }
+            entry.present = true;
+            entry.generation = handle.generation;
+            entry.cellX = cell(x);
+            entry.cellY = cell(y);
+            link(handle.slot, bucketOf(entry.cellX, entry.cellY));
+        }
+        entry.x = x;
+        entry.y = y;
+    }
+
+    /**
+     * @brief Removes a character's position, e.g. when it is despawned.
+     * @param handle The handle of the character.
+     */
+    void remove(CharacterHandle handle) {
+        if (contains(handle)) {
+            unlink(handle.slot);
+        }
+    }
+
+    /**
+     * @brief Checks whether a character has a position.
+     * @param handle The handle of the character.
+     * @return True if the character has been placed and not removed.
+     */
+    bool contains(CharacterHandle handle) const {
+        return handle.slot < entries.size() && entries[handle.slot].present
+               && entries[handle.slot].generation == handle.generation;
+    }
+
+    float getX(CharacterHandle handle) const {
+        return entries[handle.slot].x;
+    }
+
+    float getY(CharacterHandle handle) const {
+        return entries[handle.slot].y;
+    }
+
+    /**
+     * @brief Gets the generation of the character placed in a handle slot.
+     * @param slot The slot.
+     * @return The generation of its handle.
+     */
+    uint32_t getGeneration(uint32_t slot) const {
+        return entries[slot].generation;
+    }
+
+    /**
+     * @brief Finds every character within a radius of a point.
+     * 
+     * @param x The x coordinate of the center.
+     * @param y The y coordinate of the center.
+     * @param radius The radius.
+     * @param found Receives the handles; it is cleared first.
+     */
+    void queryRadius(float x, float y, float radius, vector<CharacterHandle> &found) const {
+        float squared = radius * radius;
+        query(x - radius, y - radius, x + radius, y + radius, found, [&](const Entry &entry) {
+            float dx = entry.x - x, dy = entry.y - y;
+            return dx * dx + dy * dy <= squared;
+        });
+    }
+
+    /**
+     * @brief Finds every character inside an axis-aligned box, borders included.
+     * 
+     * @param minX The smallest x coordinate.
+     * @param minY The smallest y coordinate.
+     * @param maxX The largest x coordinate.
+     * @param maxY The largest y coordinate.
+     * @param found Receives the handles; it is cleared first.
+     */
+    void queryBox(float minX, float minY, float maxX, float maxY, vector<CharacterHandle> &found) const {
+        query(minX, minY, maxX, maxY, found, [&](const Entry &entry) {
+            return entry.x >= minX && entry.x <= maxX && entry.y >= minY && entry.y <= maxY;
+        });
+    }
+
+private:
+    struct Entry {
+        float x = 0;
+        float y = 0;
+        uint32_t generation = 0;
+        uint32_t bucket = 0;
+        uint32_t index = 0;
+        int32_t cellX = 0;
+        int32_t cellY = 0;
+        bool present = false;
+    };
+
+    float cellSize;
+    float inverseCellSize;
+    float looseness;
+    uint32_t mask;
+    vector<Entry> entries;
+    vector<vector<uint32_t>> buckets;
+
+    /**
+     * @brief Gets the cell of a coordinate, clamped to [-GRID_CELL_LIMIT, GRID_CELL_LIMIT].
+     * 
+     * NaN maps to the lower limit, so it neither reaches the undefined float-to-int conversion
+     * nor makes a query loop run past the limit.
+     * 
+     * @param coordinate The coordinate.
+     * @return The cell coordinate.
+     */
+    int32_t cell(float coordinate) const {
+        float scaled = coordinate * inverseCellSize;
+        if (!(scaled > -(float)GRID_CELL_LIMIT)) {
+            return -GRID_CELL_LIMIT;
+        }
+        if (scaled >= (float)GRID_CELL_LIMIT) {
+            return GRID_CELL_LIMIT;
+        }
+        int32_t truncated = (int32_t)scaled;
+        return truncated - (scaled < (float)truncated);
+    }
+
+    bool near(int32_t home, float coordinate) const {
+        float low = (float)home * cellSize;
+        return coordinate >= low - looseness && coordinate < low + cellSize + looseness;
+    }
+
+    uint32_t bucketOf(int32_t cellX, int32_t cellY) const {
+        return ((uint32_t)cellX * 73856093u ^ (uint32_t)cellY * 19349663u) & mask;
+    }
+
+    void link(uint32_t slot, uint32_t bucket) {
+        entries[slot].bucket = bucket;
+        entries[slot].index = (uint32_t)buckets[bucket].size();
+        buckets[bucket].push_back(slot);
+    }
+
+    void unlink(uint32_t slot) {
+        Entry &entry = entries[slot];
+        vector<uint32_t> &members = buckets[entry.bucket];
+        uint32_t last = members.back();
+        members[entry.index] = last;
+        entries[last].index = entry.index;
+        members.pop_back();
+        entry.present = false;
+    }
+
+    template <class Inside>
+    void query(float minX, float minY, float maxX, float maxY, vector<CharacterHandle> &found, Inside inside) const {
+        found.clear();
+        int64_t firstX = cell(minX - looseness), firstY = cell(minY - looseness);
+        int64_t lastX = cell(maxX + looseness), lastY = cell(maxY + looseness);
+        if (lastX < firstX || lastY < firstY) {
+            return;
+        }
+        auto scan = [&](uint32_t bucket) {
+            for (uint32_t slot : buckets[bucket]) {
+                if (inside(entries[slot])) {
+                    found.push_back(CharacterHandle{slot, entries[slot].generation});
+                }
+            }
+        };
+        if ((uint64_t)(lastX - firstX + 1) * (uint64_t)(lastY - firstY + 1) > buckets.size()) {
+            for (uint32_t bucket = 0; bucket < buckets.size(); ++bucket) {
+                scan(bucket);
+            }
+            return;
+        }
+        vector<uint32_t> visited;
+        visited.reserve((lastX - firstX + 1) * (lastY - firstY + 1));
+        for (int64_t cellX = firstX; cellX <= lastX; ++cellX) {
+            for (int64_t cellY = firstY; cellY <= lastY; ++cellY) {
+                visited.push_back(bucketOf((int32_t)cellX, (int32_t)cellY));
+            }
+        }
+        sort(visited.begin(), visited.end());
+        visited.erase(unique(visited.begin(), visited.end()), visited.end());
+        for (uint32_t bucket : visited) {
+            scan(bucket);
+        }
+    }
+};
+
+/**
+ * @brief An area attack: the attacker deals its attack power to everyone within the radius.
+ */
+struct AreaAttack {
+    CharacterHandle attacker;
+    float radius;
+};
+
+/**
+ * @brief Resolves a batch of area attacks on the store of a world through the bound damage kernel.
+ * 
+ * Targets are collected with radius queries around each attacker; attackers do not hit
+ * themselves, despawned characters are skipped, and attackers without positive attack power
+ * deal no damage. Damage to the same target is summed, saturating at INT_MAX, and dealt by
+ * one batched CharacterWorld::damage() call, so the checksum and a recording replay see it,
+ * invincible characters stay unharmed and health stops at 0.
+ * 
+ * @param world The world of the characters.
+ * @param grid The positions of the characters.
+ * @param attacks The attacks of this tick.
+ * @return The number of characters hit.
+ */
+size_t resolveAreaAttacks(CharacterWorld &world, const SpatialGrid &grid, const vector<AreaAttack> &attacks) {
+    CharacterStore &store = world.store;
+    vector<pair<uint32_t, int>> hits;
+    vector<CharacterHandle> found;
+    for (const AreaAttack &attack : attacks) {
+        if (!store.contains(attack.attacker) || !grid.contains(attack.attacker)) {
+            continue;
+        }
+        int power = store.attackPower[store.rowOf(attack.attacker)];
+        if (power <= 0) {
+            continue;
+        }
+        grid.queryRadius(grid.getX(attack.attacker), grid.getY(attack.attacker), attack.radius, found);
+        for (CharacterHandle target : found) {
+            if (!(target == attack.attacker) && store.contains(target)) {
+                hits.emplace_back(target.slot, power);
+            }
+        }
+    }
+    sort(hits.begin(), hits.end());
+    vector<CharacterHandle> targets;
+    vector<int> damage;
+    for (const pair<uint32_t, int> &hit : hits) {
+        if (!targets.empty() && targets.back().slot == hit.first) {
+            damage.back() = (int)min((int64_t)damage.back() + hit.second, (int64_t)INT_MAX);
+        } else {
+            targets.push_back(CharacterHandle{hit.first, grid.getGeneration(hit.first)});
+            damage.push_back(hit.second);
+        }
+    }
+    world.damage(targets, damage);
+    return targets.size();
+}
+
+#define TICK_STEP_MICROSECONDS 16667
+#define MAX_CATCH_UP_TICKS 4
+#define TIMING_HISTORY 1024
+
+/**
+ * @brief The phases of a simulation tick, in the order they run.
+ */
+enum TickPhase {
+    PHASE_INPUT,
+    PHASE_SYSTEMS,
+    PHASE_CLEANUP,
+    PHASE_PUBLISH,
+    PHASE_COUNT
+};
+
+static const char *const tickPhaseNames[PHASE_COUNT] = {"input", "systems", "cleanup", "publish"};
+
+/**
+ * @brief What a simulation loop does when more than one tick is due.
+ */
+enum LatePolicy {
+    /**
+     * @brief Runs the late ticks back to back, at most maxCatchUp of them; the rest are dropped.
+     */
+    LATE_CATCH_UP,
+    /**
+     * @brief Runs one tick and drops the late ones, so simulated time falls behind wall time.
+     */
+    LATE_DROP
+};
+
+/**
+ * @brief The timing of one simulated tick.
+ */
+struct TickTiming {
+    uint64_t tick;
+    size_t population;
+    double phases[PHASE_COUNT];
+    double total;
+    /**
+     * @brief The number of ticks dropped right before this one.
+     */
+    uint32_t dropped;
+    /**
+     * @brief Bit p is set when phase p exceeded its budget.
+     */
+    uint32_t overBudget;
+};
+
+/**
+ * @brief The wall clock that SimulationLoop::runFor() reads and sleeps on.
+ * 
+ * The default is the steady clock; tests substitute a simulated one.
+ */
+struct LoopClock {
+    function<chrono::steady_clock::time_point()> now = []() {
+        return chrono::steady_clock::now();
+    };
+    function<void(chrono::steady_clock::time_point)> sleepUntil = [](chrono::steady_clock::time_point until) {
+        this_thread::sleep_until(until);
+    };
+};
+
+/**
+ * @class SimulationLoop
+ * @brief Fixed-timestep tick loop of a character world with per-phase budget accounting.
+ * 
+ * Every tick runs four phases: input applies the queued commands in order, systems runs the
+ * registered systems in order, cleanup despawns every character whose health dropped to 0
+ * through CharacterWorld::despawn(), so its despawn hooks run, and ends the tick of the replay
+ * being recorded, and publish ends the tick of the snapshot publisher, if any. Each phase is
+ * timed against its budget and the timings of the latest ticks are kept in a ring of fixed
+ * capacity, to be exported as CSV. Wall time is fed in by advance(), which runs the ticks
+ * that came due in steps of a fixed length, or by runFor(), which does so in real time on
+ * the loop's LoopClock.
+ */
+class SimulationLoop {
+public:
+    /**
+     * @brief Constructor to create a loop over a world.
+     * 
+     * @param world The world to simulate.
+     * @param step The fixed length of a tick.
+     * @param policy What to do with late ticks.
+     * @param maxCatchUp The maximum number of ticks run by one advance() when catching up.
+     * @param history The number of latest ticks whose timings are kept.
+     * @throw std::invalid_argument If the step is not positive or maxCatchUp or history is 0.
+     */
+    SimulationLoop(CharacterWorld &world, chrono::microseconds step = chrono::microseconds(TICK_STEP_MICROSECONDS),
+                   LatePolicy policy = LATE_CATCH_UP, size_t maxCatchUp = MAX_CATCH_UP_TICKS,
+                   size_t history = TIMING_HISTORY)
+        : world(world), step(step), policy(policy), maxCatchUp(maxCatchUp) {
+        if (step.count() <= 0 || maxCatchUp == 0 || history == 0) {
+            throw invalid_argument("Tick step, catch-up limit and timing history must be positive.");
+        }
+        timings.resize(history);
+        budgets[PHASE_INPUT] = step / 8;
+        budgets[PHASE_SYSTEMS] = step / 2;
+        budgets[PHASE_CLEANUP] = step / 8;
+        budgets[PHASE_PUBLISH] = step / 4;
+    }
+
+    /**
+     * @brief Sets the time budget of a phase.
+     * 
+     * @param phase The phase.
+     * @param budget The time the phase may take per tick.
+     */
+    void setBudget(TickPhase phase, chrono::microseconds budget) {
+        budgets[phase] = budget;
+    }
+
+    /**
+     * @brief Adds a system, run in the order added during the systems phase of every tick.
+     * @param system The system, called with the world and the number of the tick.
+     */
+    void addSystem(function<void(CharacterWorld &, uint64_t)> system) {
+        systems.push_back(move(system));
+    }
+
+    /**
+     * @brief Queues a command, applied during the input phase of the next tick.
+     * @param command The command, called with the world.
+     */
+    void command(function<void(CharacterWorld &)> command) {
+        commands.push_back(move(command));
+    }
+
+    /**
+     * @brief Sets the publisher whose tick ends in the publish phase; it must publish the world's store.
+     * @param publisher The publisher, or null for none.
+     */
+    void publishTo(SnapshotPublisher *publisher) {
+        this->publisher = publisher;
+    }
+
+    /**
+     * @brief Runs a single tick right away.
+     */
+    void tick() {
+        TickTiming timing{currentTick, 0, {}, 0, pendingDropped, 0};
+        pendingDropped = 0;
+        runPhase(timing, PHASE_INPUT, [this]() {
+            vector<function<void(CharacterWorld &)>> due;
+            due.swap(commands);
+            for (function<void(CharacterWorld &)> &command : due) {
+                command(world);
+            }
+        });
+        runPhase(timing, PHASE_SYSTEMS, [this]() {
+            for (function<void(CharacterWorld &, uint64_t)> &system : systems) {
+                system(world, currentTick);
+            }
+        });
+        runPhase(timing, PHASE_CLEANUP, [this]() {
+            world.despawn(world.store.filter(query::health == 0));
+            world.endTick();
+        });
+        runPhase(timing, PHASE_PUBLISH, [this]() {
+            if (publisher != nullptr) {
+                publisher->endTick();
+            }
+        });
+        timing.population = world.store.size();
+        timings[(firstTiming + timingCount) % timings.size()] = timing;
+        if (timingCount < timings.size()) {
+            ++timingCount;
+        } else {
+            firstTiming = (firstTiming + 1) % timings.size();
+        }
+        ++currentTick;
+    }
+
+    /**
+     * @brief Lets wall time pass and runs the ticks that came due according to the late policy.
+     * 
+     * @param elapsed The wall time since the previous call.
+     * @return The number of ticks run.
+     */
+    size_t advance(chrono::steady_clock::duration elapsed) {
+        pending += elapsed;
+        size_t due = (size_t)(pending / step);
+        pending -= due * step;
+        size_t run = min(due, policy == LATE_CATCH_UP ? maxCatchUp : (size_t)1);
+        pendingDropped += (uint32_t)(due - run);
+        droppedTicks += due - run;
+        for (size_t i = 0; i < run; ++i) {
+            tick();
+        }
+        return run;
+    }
+
+    /**
+     * @brief Sets the clock that runFor() reads and sleeps on.
+     * @param clock The clock.
+     */
+    void setClock(LoopClock clock) {
+        this->clock = move(clock);
+    }
+
+    /**
+     * @brief Runs the loop in real time, sleeping between ticks.
+     * 
+     * @param duration The wall time to run for.
+     * @return The number of ticks run.
+     */
+    size_t runFor(chrono::steady_clock::duration duration) {
+        chrono::steady_clock::time_point last = clock.now(), end = last + duration;
+        size_t run = 0;
+        while (last < end) {
+            clock.sleepUntil(min(end, last + (step - pending)));
+            chrono::steady_clock::time_point now = clock.now();
+            run += advance(now - last);
+            last = now;
+        }
+        return run;
+    }
+
+    /**
+     * @brief Writes the kept timings as CSV, one row per tick, times in milliseconds.
+     * @param out The stream to write to.
+     */
+    void writeTimings(ostream &out) const {
+        out << "tick,population";
+        for (const char *name : tickPhaseNames) {
+            out << ',' << name << "_ms";
+        }
+        out << ",total_ms,dropped,over_budget\n";
+        for (size_t index = 0; index < timingCount; ++index) {
+            const TickTiming &timing = getTiming(index);
+            out << timing.tick << ',' << timing.population;
+            for (double phase : timing.phases) {
+                out << ',' << phase;
+            }
+            out << ',' << timing.total << ',' << timing.dropped << ',';
+            for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+                if (timing.overBudget & (1u << phase)) {
+                    out << (timing.overBudget & ((1u << phase) - 1) ? "|" : "") << tickPhaseNames[phase];
+                }
+            }
+            out << '\n';
+        }
+    }
+
+    /**
+     * @brief Gets the number of kept timings, at most the history given to the constructor.
+     * @return The number of timings.
+     */
+    size_t getTimingCount() const {
+        return timingCount;
+    }
+
+    /**
+     * @brief Gets a kept timing without copying the ring.
+     * @param index The index among the kept timings, 0 being the oldest.
+     * @return The timing.
+     */
+    const TickTiming &getTiming(size_t index) const {
+        return timings[(firstTiming + index) % timings.size()];
+    }
+
+    void clearTimings() {
+        firstTiming = timingCount = 0;
+    }
+
+    uint64_t getTick() const {
+        return currentTick;
+    }
+
+    uint64_t getDroppedTicks() const {
+        return droppedTicks;
+    }
+
+    chrono::microseconds getStep() const {
+        return step;
+    }
+
+private:
+    CharacterWorld &world;
+    chrono::microseconds step;
+    LatePolicy policy;
+    size_t maxCatchUp;
+    chrono::microseconds budgets[PHASE_COUNT];
+    vector<function<void(CharacterWorld &, uint64_t)>> systems;
+    vector<function<void(CharacterWorld &)>> commands;
+    SnapshotPublisher *publisher = nullptr;
+    LoopClock clock;
+    vector<TickTiming> timings;
+    size_t firstTiming = 0;
+    size_t timingCount = 0;
+    chrono::steady_clock::duration pending{0};
+    uint64_t currentTick = 0;
+    uint64_t droppedTicks = 0;
+    uint32_t pendingDropped = 0;
+
+    template <class Phase>
+    void runPhase(TickTiming &timing, TickPhase phase, Phase body) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        body();
+        chrono::steady_clock::duration spent = chrono::steady_clock::now() - start;
+        timing.phases[phase] = chrono::duration<double, milli>(spent).count();
+        timing.total += timing.phases[phase];
+        if (spent > budgets[phase]) {
+            timing.overBudget |= 1u << phase;
+        }
+    }
+};
+
+/**
+ * @brief A tile of TILE characters with one short array per field (AoSoA).
+ * 
+ * Lanes past the end of the last tile hold health 0 and attack power 0, so kernels can
+ * process whole tiles without a tail loop and aggregates are not changed by them.
+ */
+template <size_t TILE>
+struct CharacterTile {
+    int health[TILE];
+    int attackPower[TILE];
+    CharacterId ids[TILE];
+    uint8_t nameLengths[TILE];
+    char names[TILE][MAX_NAME];
+};
+
+/**
+ * @class TiledCharacterStore
+ * @brief Stores characters as an array of fixed-size tiles, each a small structure of arrays.
+ * 
+ * Inside a tile every field is contiguous, so numeric kernels stream through health and
+ * attack power like in CharacterStore, while all fields of a character stay within one tile
+ * like in an array of GameCharacter objects. Names are stored inline in fixed-size slots,
+ * so renaming never allocates. Rows are append-only.
+ * 
+ * @tparam TILE The number of characters per tile, a power of two such as 8 or 16.
+ */
+template <size_t TILE>
+class TiledCharacterStore {
+    static_assert(TILE > 0 && (TILE & (TILE - 1)) == 0, "Tile size must be a power of two.");
+
+public:
+    typedef CharacterTile<TILE> Tile;
+
+    /**
+     * @brief Constructor to create an empty store.
+     * @param counters The counters of the world the store belongs to.
+     */
+    TiledCharacterStore(CharacterCounters &counters = GameCharacter::defaultCounters) : counters(&counters) {}
+
+    TiledCharacterStore(const TiledCharacterStore &) = delete;
+    TiledCharacterStore &operator=(const TiledCharacterStore &) = delete;
+
+    /**
+     * @brief Destructor to remove all stored characters from the object count.
+     */
+    ~TiledCharacterStore() {
+        counters->objectCount -= (int)count;
+    }
+
+    /**
+     * @brief Adds a new character to the store.
+     * 
+     * @param name The name of the character.
+     * @param health The health points of the character (positive value or -1 for invincible).
+     * @param attackPower The attack power of the character.
+     * @return The row of the new character.
+     * @throw std::invalid_argument If name, health, or attack power is invalid.
+     */
+    size_t add(const string &name, int health, int attackPower) {
+        GameCharacter::validate(name, health, attackPower);
+        if (count % TILE == 0) {
+            tiles.emplace_back();
+            Tile &tile = tiles.back();
+            memset(&tile, 0, sizeof(Tile));
+        }
+        size_t row = count++;
+        Tile &tile = tiles[row / TILE];
+        tile.health[row % TILE] = health;
+        tile.attackPower[row % TILE] = attackPower;
+        tile.ids[row % TILE] = counters->mintId();
+        storeName(tile, row % TILE, name);
+        ++counters->objectCount;
+        return row;
+    }
+
+    /**
+     * @brief Renames a character.
+     * 
+     * @param row The row of the character.
+     * @param name The new name.
+     * @throw std::invalid_argument If the name is invalid.
+     */
+    void setName(size_t row, const string &name) {
+        GameCharacter::validate(name, 1, 0);
+        storeName(tiles[row / TILE], row % TILE, name);
+    }
+
+    string getName(size_t row) const {
+        const Tile &tile = tiles[row / TILE];
+        return string(tile.names[row % TILE], tile.nameLengths[row % TILE]);
+    }
+
+    int getHealth(size_t row) const {
+        return tiles[row / TILE].health[row % TILE];
+    }
+
+    int getAttackPower(size_t row) const {
+        return tiles[row / TILE].attackPower[row % TILE];
+    }
+
+    CharacterId getPersonalId(size_t row) const {
+        return tiles[row / TILE].ids[row % TILE];
+    }
+
+    /**
+     * @brief Gets the number of stored characters.
+     * @return The row count.
+     */
+    size_t size() const {
+        return count;
+    }
+
+    /**
+     * @brief Gets the number of tiles, the last of which may be partly filled.
+     * @return The tile count.
+     */
+    size_t tileCount() const {
+        return tiles.size();
+    }
+
+    /**
+     * @brief Calls a function with every tile and the number of characters in it.
+     * 
+     * Kernels may write lanes past the count of the last tile; they are set back to health 0
+     * and attack power 0 afterwards.
+     * 
+     * @param function Called as function(Tile &tile, size_t count).
+     */
+    template <class Function>
+    void forEachTile(Function function) {
+        for (size_t t = 0; t < tiles.size(); ++t) {
+            function(tiles[t], min(TILE, count - t * TILE));
+        }
+        if (count % TILE != 0) {
+            Tile &last = tiles.back();
+            fill(last.health + count % TILE, last.health + TILE, 0);
+            fill(last.attackPower + count % TILE, last.attackPower + TILE, 0);
+        }
+    }
+
+    /**
+     * @brief Calls a function with every tile and the number of characters in it.
+     * @param function Called as function(const Tile &tile, size_t count).
+     */
+    template <class Function>
+    void forEachTile(Function function) const {
+        for (size_t t = 0; t < tiles.size(); ++t) {
+            function(tiles[t], min(TILE, count - t * TILE));
+        }
+    }
+
+private:
+    vector<Tile> tiles;
+    size_t count = 0;
+    CharacterCounters *counters;
+
+    static void storeName(Tile &tile, size_t lane, const string &name) {
+        memcpy(tile.names[lane], name.data(), name.size());
+        tile.nameLengths[lane] = (uint8_t)name.size();
+    }
+};
+
+/**
+ * @brief Measures the wall-clock time of a function call.
+ * @param function The function to run.
+ * @return The elapsed time in milliseconds.
+ */
+template <class Function>
+double measureMilliseconds(Function function) {
+    auto start = chrono::steady_clock::now();
+    function();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Fills a store with deterministic pseudo-random characters for benchmarks.
+ * @param store The store to fill.
+ * @param count The number of characters to add.
+ */
+void fillBenchmarkStore(CharacterStore &store, size_t count) {
+    static const char *benchmarkNames[] = {"Archer", "Knight", "Mage", "Rogue", "Cleric", "Leonardo da Vinci", "Jack"};
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < count; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        int health = (seed >> 8) % 8 == 0 ? -1 : 1 + (int)((seed >> 4) % MAX_HEALTH);
+        store.add(benchmarkNames[(seed >> 20) % 7], health, (int)((seed >> 12) % (MAX_POWER + 1)));
+    }
+}
+
+/**
+ * @brief Compares predicate queries with the equivalent hand-written loop.
+ */
+void benchmarkQueries() {
+    CharacterStore store;
+    fillBenchmarkStore(store, 1 << 21);
+    vector<uint32_t> expected;
+    double loop = measureMilliseconds([&]() {
+        for (size_t i = 0; i < store.size(); ++i) {
+            if (store.health[i] < 100 && store.attackPower[i] > 50) {
+                expected.push_back((uint32_t)i);
+            }
+        }
+    });
+    vector<uint32_t> selected;
+    double queried = measureMilliseconds([&]() {
+        selected = store.select(query::health < 100 && query::attackPower > 50);
+    });
+    assert(selected == expected);
+    cout << "query select (" << store.size() << " rows): loop " << loop << " ms, query " << queried << " ms" << endl;
+    size_t matches = 0;
+    double prefixLoop = measureMilliseconds([&]() {
+        for (size_t i = 0; i < store.size(); ++i) {
+            matches += store.names[i].compare(0, 2, "Le") == 0 && store.attackPower[i] > 50;
+        }
+    });
+    size_t counted = 0;
+    double prefixQuery = measureMilliseconds([&]() {
+        counted = store.count(query::nameStartsWith("Le") && query::attackPower > 50);
+    });
+    assert(counted == matches);
+    cout << "query name prefix: loop " << prefixLoop << " ms, query " << prefixQuery << " ms" << endl;
+}
+
+/**
+ * @brief Compares a fused bulk update with the equivalent hand-written loop.
+ */
+void benchmarkUpdates() {
+    CharacterStore store;
+    fillBenchmarkStore(store, 1 << 21);
+    vector<int> expected = store.health;
+    double loop = measureMilliseconds([&]() {
+        for (size_t i = 0; i < expected.size(); ++i) {
+            if (expected[i] != -1) {
+                expected[i] = min(expected[i] + 10, MAX_HEALTH);
+            }
+        }
+    });
+    double updated = measureMilliseconds([&]() {
+        store.update(query::health, query::min(query::health + 10, MAX_HEALTH), !query::invincible);
+    });
+    assert(store.health == expected);
+    cout << "bulk update (" << store.size() << " rows): loop " << loop << " ms, update " << updated << " ms" << endl;
+}
+
+/**
+ * @brief Compares an aggregation through composed views with the equivalent hand-written loop.
+ */
+void benchmarkViews() {
+    CharacterStore store;
+    fillBenchmarkStore(store, 1 << 21);
+    long long expected = 0;
+    double loop = measureMilliseconds([&]() {
+        for (size_t i = 0; i < store.size(); ++i) {
+            if (store.health[i] != 0 && store.attackPower[i] > 250) {
+                expected += store.attackPower[i];
+            }
+        }
+    });
+    long long total = 0;
+    double viewed = measureMilliseconds([&]() {
+        for (CharacterRow row : store | alive() | withPowerAbove(250)) {
+            total += row.getAttackPower();
+        }
+    });
+    long long visited = 0;
+    double flat = measureMilliseconds([&]() {
+        (store | alive() | withPowerAbove(250)).forEach([&](CharacterRow row) {
+            visited += row.getAttackPower();
+        });
+    });
+    assert(total == expected && visited == expected);
+    cout << "views (" << store.size() << " rows): loop " << loop << " ms, iterators " << viewed
+         << " ms, forEach " << flat << " ms" << endl;
+}
+
+/**
+ * @brief Measures indirect gathers with and without prefetching for growing working sets.
+ */
+void benchmarkGathers() {
+    const size_t lookups = 1 << 22;
+    for (size_t population : {(size_t)1 << 12, (size_t)1 << 16, (size_t)1 << 20}) {
+        CharacterStore store;
+        fillBenchmarkStore(store, population);
+        vector<GameCharacter *> characters;
+        for (size_t i = 0; i < population; ++i) {
+            characters.push_back(new GameCharacter(store.names[i], store.health[i], store.attackPower[i]));
+        }
+        vector<uint32_t> targets(lookups);
+        uint32_t seed = 99;
+        for (uint32_t &target : targets) {
+            seed = seed * 1664525 + 1013904223;
+            target = (seed >> 4) % population;
+        }
+        vector<int> health(lookups), attackPower(lookups);
+        cout << "gather (" << population << " characters, " << lookups << " lookups):";
+        for (size_t distance : {0, 8, 32}) {
+            double aos = measureMilliseconds([&]() {
+                gatherCharacters(characters.data(), targets.data(), lookups, health.data(), attackPower.data(), distance);
+            });
+            double soa = measureMilliseconds([&]() {
+                store.gather(targets.data(), lookups, health.data(), attackPower.data(), distance);
+            });
+            cout << " distance " << distance << ": AoS " << aos << " ms, SoA " << soa << " ms;";
+        }
+        cout << endl;
+        for (GameCharacter *character : characters) {
+            delete character;
+        }
+    }
+}
+
+/**
+ * @brief Builds a deterministic mix of valid and invalid names for validation benchmarks.
+ * @param count The number of names.
+ * @return The names.
+ */
+vector<string> benchmarkNameList(size_t count) {
+    static const char *samples[] = {"Leonardo da Vinci", "Jack", "Archer of the North", "Mage", "Sir Lancelot du Lac",
+                                    "Ja  ck", "leonardo", "Jack ", "Rogue", "Cleric Who Heals Everyone"};
+    vector<string> names;
+    for (size_t i = 0; i < count; ++i) {
+        names.push_back(samples[(i * 7) % 10]);
+    }
+    return names;
+}
+
+/**
+ * @brief Compares the hand-written name validation loop with the fused rule validator.
+ */
+void benchmarkNameValidation() {
+    vector<string> names = benchmarkNameList(1 << 20);
+    size_t loopFailures = 0, fusedFailures = 0;
+    double loop = measureMilliseconds([&]() {
+        for (const string &name : names) {
+            try {
+                GameCharacter::validate(name, -1, 0);
+            } catch (invalid_argument &) {
+                ++loopFailures;
+            }
+        }
+    });
+    double fused = measureMilliseconds([&]() {
+        for (const string &name : names) {
+            fusedFailures += NameValidator::check(name.data(), name.size()).rule != NameValidator::VALID;
+        }
+    });
+    assert(loopFailures == fusedFailures);
+    vector<string> valid;
+    for (const string &name : names) {
+        if (NameValidator::check(name.data(), name.size()).rule == NameValidator::VALID) {
+            valid.push_back(name);
+        }
+    }
+    double validLoop = measureMilliseconds([&]() {
+        for (const string &name : valid) {
+            GameCharacter::validate(name, -1, 0);
+        }
+    });
+    size_t accepted = 0;
+    double validFused = measureMilliseconds([&]() {
+        for (const string &name : valid) {
+            accepted += NameValidator::check(name.data(), name.size()).rule == NameValidator::VALID;
+        }
+    });
+    size_t dfaAccepted = 0;
+    double dfa = measureMilliseconds([&]() {
+        for (const string &name : valid) {
+            dfaAccepted += NameDfa::check(name) == NAME_VALID;
+        }
+    });
+    vector<NameCheck> results(valid.size());
+    double interleaved = measureMilliseconds([&]() {
+        NameDfa::checkBatch(valid.data(), valid.size(), results.data());
+    });
+    assert(accepted == valid.size() && dfaAccepted == valid.size());
+    assert(count(results.begin(), results.end(), NAME_VALID) == (ptrdiff_t)valid.size());
+    cout << "name validation (" << names.size() << " names, 30% invalid): loop " << loop << " ms, fused rules "
+         << fused << " ms; valid names only: loop " << validLoop << " ms, fused rules " << validFused
+         << " ms, DFA " << dfa << " ms, DFA x" << DFA_LANES << " interleaved " << interleaved << " ms" << endl;
+}
+
+/**
+ * @brief Compares minting IDs with IdMinter against a shared atomic counter on all cores.
+ */
+void benchmarkIdMinting() {
+    const int perThread = 1 << 22;
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    auto run = [&](function<void(CharacterCounters &, atomic<int64_t> &)> body) {
+        CharacterCounters counters;
+        atomic<int64_t> shared(0);
+        return measureMilliseconds([&]() {
+            vector<thread> workers;
+            for (unsigned t = 0; t < threads; ++t) {
+                workers.emplace_back(body, ref(counters), ref(shared));
+            }
+            for (thread &worker : workers) {
+                worker.join();
+            }
+        });
+    };
+    double blocks = run([&](CharacterCounters &counters, atomic<int64_t> &) {
+        IdMinter minter(counters);
+        CharacterId last = 0;
+        for (int i = 0; i < perThread; ++i) {
+            last = max(last, minter.mint());
+        }
+        assert(last > 0);
+    });
+    double atomics = run([&](CharacterCounters &, atomic<int64_t> &shared) {
+        int64_t last = 0;
+        for (int i = 0; i < perThread; ++i) {
+            last = max(last, shared.fetch_add(1));
+        }
+        assert(last >= 0);
+    });
+    double total = (double)perThread * threads;
+    cout << "ID minting (" << threads << " threads): IdMinter " << total / blocks / 1000 << " M/s, shared atomic "
+         << total / atomics / 1000 << " M/s" << endl;
+}
+
+/**
+ * @brief Runs the combat, aggregation and rename workloads on a tiled store.
+ * 
+ * @param population The number of characters.
+ * @param rounds The number of rounds per workload.
+ * @param renames The names used by the rename workload.
+ * @param checksum Accumulates a result of every workload so that none is optimized away.
+ * @return The timings of combat, aggregation and renaming in milliseconds.
+ */
+template <size_t TILE>
+vector<double> benchmarkTiledLayout(const CharacterStore &source, int rounds, const vector<string> &renames, int64_t &checksum) {
+    TiledCharacterStore<TILE> store;
+    for (size_t i = 0; i < source.size(); ++i) {
+        store.add(source.names[i], source.health[i], source.attackPower[i]);
+    }
+    typedef typename TiledCharacterStore<TILE>::Tile Tile;
+    double combat = measureMilliseconds([&]() {
+        for (int round = 0; round < rounds; ++round) {
+            store.forEachTile([](Tile &tile, size_t) {
+                for (size_t lane = 0; lane < TILE; ++lane) {
+                    int damage = tile.attackPower[lane ^ 1] / 8;
+                    int health = tile.health[lane];
+                    tile.health[lane] = health == -1 ? -1 : max(1, health - damage);
+                }
+            });
+        }
+    });
+    double aggregation = measureMilliseconds([&]() {
+        for (int round = 0; round < rounds; ++round) {
+            int64_t total = 0;
+            store.forEachTile([&](const Tile &tile, size_t) {
+                for (size_t lane = 0; lane < TILE; ++lane) {
+                    total += tile.health[lane] > 0 ? tile.health[lane] + tile.attackPower[lane] : 0;
+                }
+            });
+            checksum += total;
+        }
+    });
+    double rename = measureMilliseconds([&]() {
+        for (int round = 0; round < rounds; ++round) {
+            for (size_t row = round % 4; row < store.size(); row += 4) {
+                store.setName(row, renames[row % renames.size()]);
+            }
+        }
+    });
+    checksum += store.getHealth(0) + store.getName(store.size() - 1).size();
+    return {combat, aggregation, rename};
+}
+
+/**
+ * @brief Compares AoS, SoA and tiled AoSoA layouts on combat, aggregation and rename workloads.
+ */
+void benchmarkLayouts() {
+    const int rounds = 8;
+    vector<string> renames = {"Archer", "Knight of the Round Table", "Mage", "Leonardo da Vinci"};
+    for (size_t population : {(size_t)1 << 12, (size_t)1 << 16, (size_t)1 << 20}) {
+        CharacterStore source;
+        fillBenchmarkStore(source, population);
+        int64_t checksum = 0;
+
+        CharacterWorld objectWorld;
+        vector<GameCharacter> objects;
+        objects.reserve(population);
+        for (size_t i = 0; i < population; ++i) {
+            objects.emplace_back(objectWorld.counters, source.names[i], source.health[i], source.attackPower[i]);
+        }
+        double aosCombat = measureMilliseconds([&]() {
+            for (int round = 0; round < rounds; ++round) {
+                for (size_t i = 0; i < population; ++i) {
+                    int damage = objects[i ^ 1].attackPower / 8;
+                    int health = objects[i].health;
+                    objects[i].health = health == -1 ? -1 : max(1, health - damage);
+                }
+            }
+        });
+        double aosAggregation = measureMilliseconds([&]() {
+            for (int round = 0; round < rounds; ++round) {
+                int64_t total = 0;
+                for (const GameCharacter &character : objects) {
+                    total += character.health > 0 ? character.health + character.attackPower : 0;
+                }
+                checksum += total;
+            }
+        });
+        double aosRename = measureMilliseconds([&]() {
+            for (int round = 0; round < rounds; ++round) {
+                for (size_t row = round % 4; row < population; row += 4) {
+                    objects[row].setName(renames[row % renames.size()]);
+                }
+            }
+        });
+
+        CharacterStore store;
+        fillBenchmarkStore(store, population);
+        double soaCombat = measureMilliseconds([&]() {
+            for (int round = 0; round < rounds; ++round) {
+                int *health = store.health.data();
+                const int *attackPower = store.attackPower.data();
+                for (size_t i = 0; i < population; ++i) {
+                    int damage = attackPower[i ^ 1] / 8;
+                    health[i] = health[i] == -1 ? -1 : max(1, health[i] - damage);
+                }
+            }
+        });
+        double soaAggregation = measureMilliseconds([&]() {
+            for (int round = 0; round < rounds; ++round) {
+                int64_t total = 0;
+                for (size_t i = 0; i < population; ++i) {
+                    total += store.health[i] > 0 ? store.health[i] + store.attackPower[i] : 0;
+                }
+                checksum += total;
+            }
+        });
+        double soaRename = measureMilliseconds([&]() {
+            for (int round = 0; round < rounds; ++round) {
+                for (size_t row = round % 4; row < population; row += 4) {
+                    const string &name = renames[row % renames.size()];
+                    GameCharacter::validate(name, 1, 0);
+                    store.names[row] = name;
+                }
+            }
+        });
+
+        vector<double> tiles8 = benchmarkTiledLayout<8>(source, rounds, renames, checksum);
+        vector<double> tiles16 = benchmarkTiledLayout<16>(source, rounds, renames, checksum);
+        cout << "layouts (" << population << " characters, " << rounds << " rounds): combat AoS " << aosCombat
+             << " ms, SoA " << soaCombat << " ms, AoSoA8 " << tiles8[0] << " ms, AoSoA16 " << tiles16[0]
+             << " ms; aggregation AoS " << aosAggregation << " ms, SoA " << soaAggregation << " ms, AoSoA8 "
+             << tiles8[1] << " ms, AoSoA16 " << tiles16[1] << " ms; rename AoS " << aosRename << " ms, SoA "
+             << soaRename << " ms, AoSoA8 " << tiles8[2] << " ms, AoSoA16 " << tiles16[2] << " ms (checksum "
+             << checksum % 1000 << ")" << endl;
+    }
+}
+
+/**
+ * @brief Compares every supported kernel variant on the same columns.
+ */
+void benchmarkKernels() {
+    const size_t population = 1 << 20;
+    const int rounds = 16;
+    CharacterStore store;
+    fillBenchmarkStore(store, population);
+    vector<string> names = benchmarkNameList(population);
+    vector<int> damage(population);
+    for (size_t i = 0; i < population; ++i) {
+        damage[i] = store.attackPower[i] / 64;
+    }
+    vector<NameCheck> results(population);
+    vector<uint32_t> packed(2 * population);
+    cout << "kernels (" << population << " characters, bound " << characterKernels().name << "):";
+    for (const CharacterKernels *kernels : supportedKernels()) {
+        vector<int> health = store.health;
+        int64_t total = 0;
+        double check = measureMilliseconds([&]() {
+            kernels->checkNames(names.data(), population, results.data());
+        });
+        double combat = measureMilliseconds([&]() {
+            for (int round = 0; round < rounds; ++round) {
+                kernels->applyDamage(health.data(), damage.data(), population);
+            }
+        });
+        double aggregation = measureMilliseconds([&]() {
+            for (int round = 0; round < rounds; ++round) {
+                total += kernels->totalHealth(health.data(), population);
+            }
+        });
+        double pack = measureMilliseconds([&]() {
+            for (int round = 0; round < rounds; ++round) {
+                kernels->packStats(health.data(), store.attackPower.data(), population, packed.data());
+            }
+        });
+        cout << " " << kernels->name << ": names " << check << " ms, combat " << combat << " ms, aggregation "
+             << aggregation << " ms, packing " << pack << " ms (total " << total % 1000 << ");";
+    }
+    cout << endl;
+}
+
+/**
+ * @brief Reports ratio and speed of block compression on a typical roster.
+ */
+void benchmarkCompression() {
+    CharacterStore store;
+    fillBenchmarkStore(store, 1 << 20);
+    vector<uint32_t> rows(store.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        rows[i] = (uint32_t)i;
+    }
+    vector<uint8_t> raw = store.packMigration(rows);
+    double megabytes = raw.size() / 1e6;
+    for (unsigned workers : {1u, max(1u, thread::hardware_concurrency())}) {
+        vector<uint8_t> packed;
+        double compression = measureMilliseconds([&]() {
+            packed = compressBlocks(raw, COMPRESSION_BLOCK_SIZE, workers);
+        });
+        vector<uint8_t> restored;
+        double decompression = measureMilliseconds([&]() {
+            restored = CompressedBlocks(packed).decompressAll(workers);
+        });
+        assert(restored == raw);
+        cout << "compression (" << megabytes << " MB migration buffer, " << workers << " threads): ratio "
+             << (double)raw.size() / packed.size() << ", compress " << megabytes / compression * 1000 << " MB/s, decompress "
+             << megabytes / decompression * 1000 << " MB/s" << endl;
+    }
+}
+
+/**
+ * @brief Measures recording overhead and full-speed playback of a recorded session.
+ */
+void benchmarkReplay() {
+    const int ticks = 256, operationsPerTick = 4096;
+    auto simulate = [&](CharacterWorld &world) {
+        vector<CharacterHandle> live;
+        uint32_t seed = 77;
+        for (int tick = 0; tick < ticks; ++tick) {
+            for (int operation = 0; operation < operationsPerTick; ++operation) {
+                seed = seed * 1664525 + 1013904223;
+                size_t victim = live.empty() ? 0 : (seed >> 12) % live.size();
+                int kind = live.size() < 1000 ? 0 : (seed >> 8) % 8;
+                if (kind <= 1) {
+                    live.push_back(world.spawn("Knight", 1 + (seed >> 4) % MAX_HEALTH, (seed >> 16) % MAX_POWER));
+                } else if (kind == 2) {
+                    world.rename(live[victim], "Leonardo da Vinci");
+                } else if (kind == 3 && live.size() > 1000) {
+                    world.despawn(live[victim]);
+                    live[victim] = live.back();
+                    live.pop_back();
+                } else {
+                    world.damage(live[victim], (seed >> 20) % 16);
+                }
+            }
+            world.endTick();
+        }
+    };
+    CharacterWorld plain;
+    double unrecorded = measureMilliseconds([&]() {
+        simulate(plain);
+    });
+    CharacterWorld recorded;
+    ReplayRecorder recorder(recorded.counters);
+    recorded.record(&recorder);
+    double recording = measureMilliseconds([&]() {
+        simulate(recorded);
+    });
+    CharacterWorld played;
+    ReplayPlayer player(recorder.data());
+    size_t operations = 0;
+    double playback = measureMilliseconds([&]() {
+        operations = player.playAll(played);
+    });
+    double seeking = measureMilliseconds([&]() {
+        player.seek(played, ticks / 2 + 1);
+    });
+    cout << "replay (" << ticks << " ticks, " << operations << " operations, " << recorder.data().size() / 1024
+         << " KiB): unrecorded " << unrecorded << " ms, recorded " << recording << " ms, playback " << playback
+         << " ms, seek " << seeking << " ms" << endl;
+}
+
+/**
+ * @brief Measures the tick-time overhead of versioned columns, with and without a scanning reader.
+ */
+void benchmarkVersionedReads() {
+    const size_t population = 1 << 20;
+    const int ticks = 200, writesPerTick = 10000;
+    CharacterStore store;
+    fillBenchmarkStore(store, population);
+    VersionedColumns versioned(population);
+    versioned.sync(store);
+    versioned.commit();
+    vector<CharacterHandle> handles(population);
+    for (size_t row = 0; row < population; ++row) {
+        handles[row] = store.find(store.ids[row]);
+    }
+    auto simulate = [&](function<void(size_t, int)> write, function<void()> commit) {
+        uint32_t seed = 31;
+        return measureMilliseconds([&]() {
+            for (int tick = 0; tick < ticks; ++tick) {
+                for (int i = 0; i < writesPerTick; ++i) {
+                    seed = seed * 1664525 + 1013904223;
+                    write((seed >> 8) % population, 1 + (int)(seed % MAX_HEALTH));
+                }
+                commit();
+            }
+        }) / ticks;
+    };
+    auto write = [&](size_t row, int value) {
+        store.set(handles[row], value, store.attackPower[row]);
+    };
+    double plain = simulate(write, []() {});
+    auto commit = [&]() {
+        versioned.sync(store);
+        versioned.commit();
+    };
+    double alone = simulate(write, commit);
+    atomic<bool> done(false);
+    atomic<size_t> scans(0);
+    thread reader([&]() {
+        while (!done) {
+            VersionedColumns::ReadView view = versioned.pin();
+            int64_t total = 0;
+            view.forEachChunk([&](size_t, size_t rows, const int *health, const int *, const CharacterId *) {
+                for (size_t row = 0; row < rows; ++row) {
+                    total += health[row];
+                }
+            });
+            scans += total != 0;
+        }
+    });
+    double scanned = simulate(write, commit);
+    done = true;
+    reader.join();
+    cout << "versioned reads (" << population << " characters, " << writesPerTick << " writes per tick): plain "
+         << plain << " ms/tick, MVCC " << alone << " ms/tick, MVCC with scanning reader " << scanned << " ms/tick ("
+         << scans << " scans)" << endl;
+}
+
+/**
+ * @brief Measures incremental snapshot publication after scattered and localized writes.
+ */
+void benchmarkSnapshots() {
+    const size_t population = 1 << 20;
+    CharacterStore store;
+    fillBenchmarkStore(store, population);
+    double full = 0;
+    SnapshotPublisher *created = nullptr;
+    full = measureMilliseconds([&]() {
+        created = new SnapshotPublisher(store);
+    });
+    unique_ptr<SnapshotPublisher> publisher(created);
+    cout << "snapshots (" << population << " characters): full build " << full << " ms;";
+    for (size_t spread : {population, population / 16}) {
+        uint32_t seed = 17;
+        for (int i = 0; i < 1000; ++i) {
+            seed = seed * 1664525 + 1013904223;
+            size_t row = (seed >> 8) % spread;
+            int health = store.health[row] == -1 ? -1 : 1 + (store.health[row] + 1) % MAX_HEALTH;
+            store.set(store.find(store.ids[row]), health, store.attackPower[row]);
+        }
+        size_t rebuilt = 0;
+        double publish = measureMilliseconds([&]() {
+            rebuilt = publisher->publish();
+        });
+        double unchanged = measureMilliseconds([&]() {
+            publisher->publish();
+        });
+        cout << " 1000 writes over " << spread << " rows: publish " << publish << " ms (" << rebuilt
+             << " chunks rebuilt), unchanged publish " << unchanged << " ms;";
+    }
+    cout << endl;
+}
+
+/**
+ * @brief Compares a one-shot roster import with slices of a 2 ms budget.
+ */
+void benchmarkImport() {
+    const size_t records = 1 << 20;
+    string roster;
+    vector<string> names = benchmarkNameList(records);
+    for (size_t i = 0; i < records; ++i) {
+        roster += names[i] + "," + to_string(1 + i % MAX_HEALTH) + "," + to_string(i % MAX_POWER) + "\n";
+    }
+    CharacterWorld oneShot;
+    ImportJob whole(oneShot, roster);
+    double total = measureMilliseconds([&]() {
+        whole.run(chrono::hours(1));
+    });
+    CharacterWorld sliced;
+    ImportJob job(sliced, roster);
+    vector<double> slices;
+    for (bool finished = false; !finished;) {
+        slices.push_back(measureMilliseconds([&]() {
+            finished = job.run(chrono::microseconds(2000)).finished;
+        }));
+    }
+    sort(slices.begin(), slices.end());
+    cout << "import (" << records << " records, " << job.progress().imported << " valid): one shot " << total
+         << " ms; 2 ms slices: " << slices.size() << " slices, p50 " << slices[slices.size() / 2] << " ms, p99 "
+         << slices[slices.size() * 99 / 100] << " ms, max " << slices.back() << " ms" << endl;
+}
+
+/**
+ * @brief Compares restoring a columnar snapshot into a store with lazily named restoration.
+ */
+void benchmarkLazyRestore() {
+    const size_t population = 1 << 20;
+    CharacterStore store;
+    fillBenchmarkStore(store, population);
+    string path = "/tmp/characters_bench_" + to_string(getpid()) + ".columns";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    writeColumnar(fd, store);
+    close(fd);
+    {
+        MappedFile mapped(path);
+        ColumnarFile file(mapped.data(), mapped.length());
+        CharacterWorld eagerWorld, lazyWorld;
+        double eager = measureMilliseconds([&]() {
+            eagerWorld.store.reserve(population);
+            for (size_t index = 0; index < file.batchCount(); ++index) {
+                ColumnarBatch batch = file.batch(index);
+                for (size_t row = 0; row < batch.length; ++row) {
+                    eagerWorld.store.add(batch.getName(row), batch.health[row], batch.attackPower[row], batch.ids[row]);
+                }
+            }
+        });
+        vector<CharacterHandle> restored;
+        double lazy = measureMilliseconds([&]() {
+            restored = lazyWorld.store.restoreColumnar(file);
+        });
+        size_t length = 0;
+        double touch = measureMilliseconds([&]() {
+            for (size_t row = 0; row < population; row += 100) {
+                length += lazyWorld.store.getName(restored[row]).size();
+            }
+        });
+        NameMetrics metrics = lazyWorld.store.getNameMetrics();
+        cout << "lazy restore (" << population << " characters): eager " << eager << " ms, lazy " << lazy
+             << " ms, touching " << metrics.touched << " of " << metrics.restored << " names " << touch
+             << " ms (" << length / metrics.touched << " bytes per name)" << endl;
+    }
+    unlink(path.c_str());
+}
+
+/**
+ * @brief Measures moving a million positioned characters per tick and resolving area attacks.
+ */
+void benchmarkSpatialGrid() {
+    const size_t population = 1 << 20;
+    const float extent = 8192;
+    CharacterWorld world;
+    fillBenchmarkStore(world.store, population);
+    SpatialGrid grid(16, 1 << 18);
+    vector<float> xs(population), ys(population);
+    uint32_t seed = 99;
+    auto next = [&seed]() {
+        seed = seed * 1664525 + 1013904223;
+        return (float)(seed >> 8) / (1 << 24);
+    };
+    double place = measureMilliseconds([&]() {
+        for (uint32_t slot = 0; slot < population; ++slot) {
+            xs[slot] = next() * extent;
+            ys[slot] = next() * extent;
+            grid.place(CharacterHandle{slot, 0}, xs[slot], ys[slot]);
+        }
+    });
+    vector<AreaAttack> attacks;
+    for (uint32_t attacker = 0; attacker < population; attacker += 1024) {
+        attacks.push_back(AreaAttack{CharacterHandle{attacker, 0}, 24});
+    }
+    const int ticks = 10;
+    double move = 0, attack = 0;
+    size_t hit = 0;
+    for (int tick = 0; tick < ticks; ++tick) {
+        move += measureMilliseconds([&]() {
+            for (uint32_t slot = 0; slot < population; ++slot) {
+                xs[slot] += next() * 2 - 1;
+                ys[slot] += next() * 2 - 1;
+                grid.place(CharacterHandle{slot, 0}, xs[slot], ys[slot]);
+            }
+        });
+        attack += measureMilliseconds([&]() {
+            hit += resolveAreaAttacks(world, grid, attacks);
+        });
+    }
+    cout << "spatial grid (" << population << " characters): place " << place << " ms, move all " << move / ticks
+         << " ms per tick, " << attacks.size() << " area attacks " << attack / ticks << " ms per tick ("
+         << hit / ticks << " hits)" << endl;
+}
+
+/**
+ * @brief Shows where the time of a simulated tick goes at growing populations.
+ */
+void benchmarkSimulationLoop() {
+    for (size_t population : {size_t(1) << 16, size_t(1) << 18, size_t(1) << 20}) {
+        CharacterWorld world;
+        fillBenchmarkStore(world.store, population);
+        SnapshotPublisher publisher(world.store);
+        SpatialGrid grid(16, 1 << 18);
+        vector<float> xs(population), ys(population);
+        uint32_t seed = 7;
+        auto next = [&seed]() {
+            seed = seed * 1664525 + 1013904223;
+            return (float)(seed >> 8) / (1 << 24);
+        };
+        for (uint32_t slot = 0; slot < population; ++slot) {
+            xs[slot] = next() * 8192;
+            ys[slot] = next() * 8192;
+            grid.place(CharacterHandle{slot, 0}, xs[slot], ys[slot]);
+        }
+        world.onDespawn([&](CharacterHandle handle) {
+            grid.remove(handle);
+        });
+        SimulationLoop loop(world);
+        loop.publishTo(&publisher);
+        loop.addSystem([&](CharacterWorld &simulated, uint64_t) {
+            for (uint32_t slot = 0; slot < population; ++slot) {
+                CharacterHandle handle{slot, 0};
+                if (simulated.store.contains(handle)) {
+                    xs[slot] += next() * 2 - 1;
+                    ys[slot] += next() * 2 - 1;
+                    grid.place(handle, xs[slot], ys[slot]);
+                }
+            }
+        });
+        loop.addSystem([&](CharacterWorld &simulated, uint64_t tick) {
+            vector<AreaAttack> attacks;
+            for (uint32_t slot = (uint32_t)tick; slot < population; slot += 4096) {
+                attacks.push_back(AreaAttack{CharacterHandle{slot, 0}, 24});
+            }
+            resolveAreaAttacks(simulated, grid, attacks);
+        });
+        const int ticks = 30;
+        for (int tick = 0; tick < ticks; ++tick) {
+            for (uint32_t slot = tick; slot < population; slot += 1024) {
+                loop.command([slot](CharacterWorld &simulated) {
+                    CharacterHandle handle{slot, 0};
+                    if (simulated.store.contains(handle)) {
+                        simulated.damage(handle, 50);
+                    }
+                });
+            }
+            loop.tick();
+        }
+        double phases[PHASE_COUNT] = {}, worst = 0;
+        size_t overBudget = 0;
+        for (size_t index = 0; index < loop.getTimingCount(); ++index) {
+            const TickTiming &timing = loop.getTiming(index);
+            for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+                phases[phase] += timing.phases[phase] / ticks;
+            }
+            worst = max(worst, timing.total);
+            overBudget += timing.total > loop.getStep().count() / 1000.0;
+        }
+        cout << "simulation loop (" << population << " characters):";
+        for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+            cout << ' ' << tickPhaseNames[phase] << ' ' << phases[phase] << " ms";
+        }
+        cout << ", worst tick " << worst << " ms, " << overBudget << " of " << ticks << " ticks over "
+             << loop.getStep().count() / 1000.0 << " ms" << endl;
+    }
+}
+
+/**
+ * @brief Runs all benchmarks and prints their timings.
+ */
+void runBenchmarks() {
+    benchmarkQueries();
+    benchmarkUpdates();
+    benchmarkViews();
+    benchmarkGathers();
+    benchmarkNameValidation();
+    benchmarkIdMinting();
+    benchmarkLayouts();
+    benchmarkKernels();
+    benchmarkCompression();
+    benchmarkReplay();
+    benchmarkVersionedReads();
+    benchmarkSnapshots();
+    benchmarkImport();
+    benchmarkLazyRestore();
+    benchmarkSpatialGrid();
+    benchmarkSimulationLoop();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        runBenchmarks();
+        return 0;
+    }
+    try {
+        assert(GameCharacter::getObjectCount() == 0);
+
+        GameCharacter *npc[3];
+
+        npc[0] = new GameCharacter("Leonardo da Vinci", 1000, 20);
+
+        assert(npc[0]->toString() == "Leonardo da Vinci 1000 20");
+        assert(GameCharacter::getObjectCount() == 1);
+
+        assert(npc[0]->getPersonalId() == 0);
+        assert(npc[0]->getName() == "Leonardo da Vinci");
+        assert(npc[0]->getHealth() == 1000);
+        assert(npc[0]->getAttackPower() == 20);
+    
+        npc[1] = new GameCharacter();
+
+        assert(npc[1]->toString() == "Name -1 0");
+        assert(GameCharacter::getObjectCount() == 2);
+        assert(GameCharacter::getIdCount() == 2);
+    
+        assert(npc[1]->getPersonalId() == 1);
+        assert(npc[1]->getName() == "Name");
+        assert(npc[1]->getHealth() == -1);
+        assert(npc[1]->getAttackPower() == 0);
+
+        npc[1]->setName("B");
+        assert(npc[1]->getName() == "B");
+
+        npc[2] = new GameCharacter("Jack", 10, 30);
+
+        assert(GameCharacter::getObjectCount() == 3);
+        assert(GameCharacter::getIdCount() == 3);
+    
+        assert(npc[2]->getPersonalId() == 2);
+        assert(npc[2]->getName() == "Jack");
+        assert(npc[2]->getHealth() == 10);
+        assert(npc[2]->getAttackPower() == 30);
+
+
+        uint32_t targets[] = {2, 0, 2, 1};
+        int gatheredHealth[4], gatheredAttack[4];
+        gatherCharacters(npc, targets, 4, gatheredHealth, gatheredAttack, 1);
+        assert(gatheredHealth[0] == 10 && gatheredHealth[1] == 1000 && gatheredHealth[3] == -1);
+        assert(gatheredAttack[0] == 30 && gatheredAttack[2] == 30 && gatheredAttack[3] == 0);
+
+        for (string name : {"Leonardo da Vinci", "", "leonardo", "Abcdefghijklmnopqrstuvwxyzabcdefg", "Jack ",
+                            "Ja ck", "Ja  ck", "Ja1ck", "A  ", "Ab c d", "B", "Tab\tName", "Jack!", "A !", "A 1 ",
+                            "Ab  ", "Ab1 "}) {
+            string expected = "valid", fused = "valid";
+            try {
+                GameCharacter::validate(name, -1, 0);
+            } catch (invalid_argument &e) {
+                expected = e.what();
+            }
+            try {
+                NameValidator::validate(name);
+            } catch (invalid_argument &e) {
+                fused = e.what();
+            }
+            assert(fused == expected);
+        }
+        vector<string> dfaNames = {"Leonardo da Vinci", "", "leonardo", "Abcdefghijklmnopqrstuvwxyzabcdefg", "Jack ",
+                                   "Ja ck", "Ja  ck", "Ja1ck", "A  ", "Ab c d", "B", "Tab\tName", "Jack!", "A !", "A 1 ",
+                                   "Ab  ", "Z", "Ab1 "};
+        vector<NameCheck> batch(dfaNames.size());
+        NameDfa::checkBatch(dfaNames.data(), dfaNames.size(), batch.data());
+        for (size_t i = 0; i < dfaNames.size(); ++i) {
+            string expected = "valid";
+            try {
+                GameCharacter::validate(dfaNames[i], -1, 0);
+            } catch (invalid_argument &e) {
+                expected = e.what();
+            }
+            assert(batch[i] == NameDfa::check(dfaNames[i]));
+            assert(batch[i] == NAME_VALID ? expected == "valid" : expected == NameDfa::message(batch[i]));
+        }
+
+        RuleViolation violation = NameValidator::check("Ja  ck", 6);
+        assert(violation.rule == 5 && violation.position == 3);
+        assert(NameValidator::check("Jack", 4).rule == NameValidator::VALID);
+
+        for (int i = 0; i < 3; ++i) {
             delete npc[i];
 
         }
         assert(GameCharacter::getObjectCount() == 0);
         assert(GameCharacter::getIdCount() == 3);
 
+        {
+            static_assert(sizeof(ObservedCharacter<NoObservers>) == sizeof(GameCharacter), "Observers must not add state.");
+            vector<string> renamed;
+            RuntimeObservers::renameHooks.push_back([&](GameCharacter &character, const string &oldName) {
+                renamed.push_back(oldName + " to " + character.getName());
+            });
+            {
+                ObservedCharacter<ObserverList<LifecycleCounters, RuntimeObservers>> hero("Hero", 100, 10);
+                ObservedCharacter<NoObservers> quiet;
+                assert(LifecycleCounters::inits == 1 && GameCharacter::getObjectCount() == 2);
+                hero.setName("Villain");
+                quiet.setName("Silent");
+                assert(LifecycleCounters::renames == 1 && renamed == vector<string>({"Hero to Villain"}));
+                bool thrown = false;
+                try {
+                    hero.setName("bad");
+                } catch (invalid_argument &) {
+                    thrown = true;
+                }
+                assert(thrown && LifecycleCounters::renames == 1 && hero.getName() == "Villain");
+            }
+            assert(LifecycleCounters::destroys == 1 && GameCharacter::getObjectCount() == 0);
+            RuntimeObservers::renameHooks.clear();
+        }
+
+        {
+            CharacterId base = GameCharacter::getIdCount();
+            CharacterStore store;
+            store.workers = 4;
+            store.add("Leonardo da Vinci", 1000, 20);
+            store.add("Jack", 10, 300);
+            store.add("Leia", 50, 60);
+            store.add("Name", -1, 0);
+
+            assert(store.size() == 4);
+            assert(store.ids[0] == base && store.ids[3] == base + 3);
+            assert(GameCharacter::getObjectCount() == 4);
+
+            assert(store.select(query::health < 100 && query::attackPower > 50) == vector<uint32_t>({1, 2}));
+            assert(store.select(query::nameStartsWith("Le")) == vector<uint32_t>({0, 2}));
+            assert(store.select(query::health == -1 || query::id == base) == vector<uint32_t>({0, 3}));
+            assert(store.select(!(query::attackPower <= 20)) == vector<uint32_t>({1, 2}));
+            assert(store.filter(query::health > 20)[0] == 0x5);
+            assert(store.count(query::nameStartsWith("Le") && query::attackPower > 50) == 1);
+
+            for (int i = 0; i < 40000; ++i) {
+                store.add("Jack", 1 + i % MAX_HEALTH, i % (MAX_POWER + 1));
+            }
+            vector<uint32_t> expected;
+            for (size_t i = 0; i < store.size(); ++i) {
+                if (store.health[i] < 100 && store.attackPower[i] > 50) {
+                    expected.push_back((uint32_t)i);
+                }
+            }
+            assert(store.select(query::health < 100 && query::attackPower > 50) == expected);
+
+            store.update(query::health, query::min(query::health + 10, MAX_HEALTH), !query::invincible);
+            assert(store.health[0] == 1000 && store.health[1] == 20 && store.health[3] == -1);
+            assert(store.health[4] == 11 && store.health[4 + 999] == 1000);
+
+            assert(store.update(query::attackPower, query::attackPower * 2, query::id < base + 3) == 3);
+            assert(store.attackPower[0] == 40 && store.attackPower[1] == MAX_POWER && store.attackPower[3] == 0);
+
+            bool rejected = false;
+            try {
+                store.update(query::health, query::health - 20, query::nameStartsWith("Jack"), REJECT_INVALID);
+            } catch (invalid_argument &e) {
+                rejected = string(e.what()) == "Health must be positive or -1 for invincible character.";
+            }
+            assert(rejected);
+            assert(store.health[1] == 20 && store.health[4] == 11);
+
+            assert(store.update(query::health, query::Constant(5), query::health < 5 && !query::invincible) == 0);
+            assert(store.update(query::health, query::health - 20, query::id == base + 1) == 1);
+            assert(store.health[1] == 0);
+            assert(store.update(query::health, query::Constant(19), query::id == base + 1) == 1);
+            rejected = false;
+            try {
+                store.update(query::health, query::health - 20, query::id == base + 1, REJECT_INVALID);
+            } catch (invalid_argument &e) {
+                rejected = string(e.what()) == "Health updates cannot make a character invincible.";
+            }
+            assert(rejected && store.health[1] == 19);
+            rejected = false;
+            try {
+                store.update(query::attackPower, query::attackPower + MAX_POWER, query::id == base + 1, REJECT_INVALID);
+            } catch (invalid_argument &e) {
+                rejected = string(e.what()) == "Attack power cannot exceed " + to_string(MAX_POWER) + ".";
+            }
+            assert(rejected && store.attackPower[1] == MAX_POWER);
+            assert(store.update(query::health, query::health - 20, query::id == base + 1 || query::invincible) >= 2);
+            assert(store.health[1] == 0 && store.health[3] == -1);
+            assert(store.update(query::health, query::Constant(1), query::id == base + 1) == 1);
+
+            vector<string> strong;
+            for (const string &name : store | alive() | withPowerAbove(35) | names()) {
+                strong.push_back(name);
+                if (strong.size() == 3) {
+                    break;
+                }
+            }
+            assert(strong == vector<string>({"Leonardo da Vinci", "Jack", "Leia"}));
+
+            auto immortal = store | invincible();
+            auto it = immortal.begin();
+            assert(it != immortal.end() && it.index() == 3 && (*it).getName() == "Name");
+            assert(++it == immortal.end());
+
+            size_t viewed = 0;
+            for (CharacterRow row : store | alive() | withPowerAbove(MAX_POWER - 1)) {
+                assert(row.getAttackPower() == MAX_POWER);
+                ++viewed;
+            }
+            assert(viewed == store.count(query::attackPower > MAX_POWER - 1));
+            size_t visited = 0;
+            (store | alive() | withPowerAbove(MAX_POWER - 1)).forEach([&](CharacterRow) {
+                ++visited;
+            });
+            assert(visited == viewed);
+#if __cplusplus >= 202002L
+            static_assert(ranges::view<decltype(store | alive() | names())>);
+            auto firstTwo = store | alive() | names() | views::take(2);
+            assert(*ranges::next(firstTwo.begin()) == "Jack");
+#endif
+
+            uint32_t targets[] = {2, 40003, 0, 2, 1};
+            int gatheredHealth[5], gatheredAttack[5];
+            for (size_t distance : {0, 1, 16}) {
+                store.gather(targets, 5, gatheredHealth, gatheredAttack, distance);
+                for (int i = 0; i < 5; ++i) {
+                    assert(gatheredHealth[i] == store.health[targets[i]]);
+                    assert(gatheredAttack[i] == store.attackPower[targets[i]]);
+                }
+            }
+
+            for (int i = 40000; i < 200000; ++i) {
+                store.add("Jack", 1 + i % MAX_HEALTH, i % (MAX_POWER + 1));
+            }
+            CharacterHandle leia = store.find(base + 2);
+            assert(store.rowOf(leia) == 2);
+            vector<uint64_t> deaths = store.filter(query::id == base || query::id == base + 3 || query::id == base + 5);
+            size_t before = store.size();
+            assert(store.despawn(deaths) == 3);
+            assert(store.size() == before - 3);
+            assert(GameCharacter::getObjectCount() == (int)store.size());
+            assert(store.names[store.rowOf(leia)] == "Leia" && store.ids[store.rowOf(leia)] == base + 2);
+            assert(store.ids[0] == base + 200003 && store.ids[3] == base + 200002);
+            bool stale = false;
+            try {
+                store.find(base);
+            } catch (invalid_argument &) {
+                stale = true;
+            }
+            assert(stale);
+            assert(store.contains(store.find(base + 200003)) && store.rowOf(store.find(base + 200003)) == 0);
+
+            vector<uint64_t> cull = store.filter(query::id % 3 != 0);
+            size_t survivors = store.count(query::id % 3 == 0);
+            assert(store.despawn(cull) >= DESPAWN_PARALLEL_ROWS / 3);
+            assert(store.size() == survivors && GameCharacter::getObjectCount() == (int)survivors);
+            assert(store.select(query::id % 3 != 0).empty());
+            assert(!store.contains(leia));
+            for (size_t row = 0; row < store.size(); row += 997) {
+                assert(store.rowOf(store.find(store.ids[row])) == row);
+                assert(row == 0 || store.ids[row] > store.ids[row - 1]);
+            }
+            CharacterHandle reused = store.add("Jack", 10, 10);
+            assert(store.ids[store.rowOf(reused)] == base + 200004);
+
+            {
+                CharacterStore receiver;
+                receiver.add("Leonardo da Vinci", 1000, 20);
+                CharacterId occupied = receiver.ids[0];
+                vector<uint32_t> leaving = {0, (uint32_t)store.rowOf(store.find(base + 200004)), 1};
+                vector<uint8_t> buffer = store.packMigration(leaving);
+                int pipeEnds[2];
+                assert(pipe(pipeEnds) == 0);
+                thread sender([&]() {
+                    writeMigration(pipeEnds[1], buffer);
+                });
+                vector<uint8_t> received = readMigration(pipeEnds[0]);
+                sender.join();
+                close(pipeEnds[0]);
+                close(pipeEnds[1]);
+                assert(received == buffer);
+
+                assert(pipe(pipeEnds) == 0);
+                thread compressedSender([&]() {
+                    writeMigration(pipeEnds[1], buffer, true);
+                });
+                assert(readMigration(pipeEnds[0]) == buffer);
+                compressedSender.join();
+                close(pipeEnds[0]);
+                close(pipeEnds[1]);
+
+                assert(pipe(pipeEnds) == 0);
+                vector<uint8_t> hostile;
+                putLittleEndian(hostile, (MAX_MIGRATION_FRAME + 1) | MIGRATION_COMPRESSED, 8);
+                assert(write(pipeEnds[1], hostile.data(), hostile.size()) == 8);
+                bool refused = false;
+                try {
+                    readMigration(pipeEnds[0]);
+                } catch (runtime_error &e) {
+                    refused = string(e.what()).find("exceeds") != string::npos;
+                }
+                assert(refused);
+                close(pipeEnds[0]);
+                close(pipeEnds[1]);
+
+                CharacterId nextId = GameCharacter::getIdCount();
+                vector<CharacterHandle> kept = receiver.installMigration(received, KEEP_IDS);
+                assert(kept.size() == 3 && receiver.size() == 4);
+                assert(receiver.ids[receiver.rowOf(kept[0])] == nextId && store.ids[0] != nextId);
+                assert(receiver.names[receiver.rowOf(kept[1])] == "Jack" && receiver.health[receiver.rowOf(kept[1])] == 10);
+                assert(GameCharacter::getIdCount() == nextId + 3);
+
+                received[received.size() - 20] ^= 1;
+                bool corrupt = false;
+                try {
+                    receiver.installMigration(received, REMAP_IDS);
+                } catch (invalid_argument &e) {
+                    corrupt = string(e.what()) == "Migration buffer checksum mismatch.";
+                }
+                assert(corrupt && receiver.size() == 4);
+
+                vector<uint8_t> again = receiver.packMigration({1, 2});
+                vector<CharacterHandle> remapped = receiver.installMigration(again, KEEP_IDS);
+                assert(receiver.ids[receiver.rowOf(remapped[0])] == nextId + 3);
+                assert(receiver.ids[receiver.rowOf(remapped[1])] == nextId + 4);
+                assert(receiver.names[receiver.rowOf(remapped[1])] == receiver.names[2]);
+                assert(receiver.ids[0] == occupied && GameCharacter::getIdCount() == nextId + 5);
+
+                auto reseal = [](vector<uint8_t> forged) {
+                    forged.resize(forged.size() - 8);
+                    putLittleEndian(forged, fnv1a64(forged.data(), forged.size()), 8);
+                    return forged;
+                };
+                vector<uint8_t> overcounted = again, trailing = again;
+                overcounted[5] = 3;
+                trailing.insert(trailing.end() - 8, 2, 'x');
+                for (const vector<uint8_t> &forged : {reseal(overcounted), reseal(trailing)}) {
+                    size_t rows = receiver.size();
+                    try {
+                        receiver.installMigration(forged, REMAP_IDS);
+                        assert(false);
+                    } catch (invalid_argument &) {
+                        assert(receiver.size() == rows && GameCharacter::getIdCount() == nextId + 5);
+                    }
+                }
+            }
+            assert(GameCharacter::getObjectCount() == (int)store.size());
+
+            bool thrown = false;
+            try {
+                store.add("jack", 10, 10);
+            } catch (invalid_argument &) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+        assert(GameCharacter::getObjectCount() == 0);
+        assert(GameCharacter::getIdCount() == 200016);
+
+        static_assert(!is_copy_constructible<GameCharacter>::value && !is_copy_assignable<GameCharacter>::value,
+                      "Copies would share a unique ID.");
+        static_assert(is_nothrow_move_constructible<GameCharacter>::value, "Vectors must move characters.");
+        {
+            CharacterPool pool;
+            vector<CharacterHandle> handles;
+            for (int i = 0; i < 10 * POOL_PAGE_SIZE; ++i) {
+                handles.push_back(pool.create("Jack", 1 + i, i % (MAX_POWER + 1)));
+            }
+            assert(pool.metrics().pages == 10 && pool.metrics().fragmentation == 0.0);
+            assert(GameCharacter::getObjectCount() == 10 * POOL_PAGE_SIZE);
+            for (int i = 0; i < 10 * POOL_PAGE_SIZE; ++i) {
+                if (i % 4 != 0) {
+                    pool.destroy(handles[i]);
+                }
+            }
+            PoolMetrics fragmented = pool.metrics();
+            assert(fragmented.live == 160 && fragmented.pages == 10 && fragmented.minimumPages == 3);
+            assert(fragmented.occupancy == 0.25 && fragmented.fragmentation == 0.7);
+
+            DefragmentReport step = pool.defragment(chrono::microseconds(0));
+            assert(step.moved == DEFRAG_CLOCK_INTERVAL && !step.finished);
+            assert(step.before.pages == 10 && pool.get(handles[36 * 4]).getHealth() == 36 * 4 + 1);
+            while (!step.finished) {
+                step = pool.defragment(chrono::microseconds(1000));
+            }
+            assert(step.after.pages == 3 && step.after.fragmentation == 0.0);
+            assert(GameCharacter::getObjectCount() == 160);
+            for (int i = 0; i < 10 * POOL_PAGE_SIZE; i += 4) {
+                GameCharacter &character = pool.get(handles[i]);
+                assert(character.getHealth() == 1 + i && character.getName() == "Jack");
+                assert(pool.find(character.getPersonalId()) == handles[i]);
+            }
+            assert(!pool.contains(handles[1]));
+            int visited = 0;
+            pool.forEach([&](GameCharacter &) {
+                ++visited;
+            });
+            assert(visited == 160);
+        }
+        assert(GameCharacter::getObjectCount() == 0);
+        assert(GameCharacter::getIdCount() == 200016 + 10 * POOL_PAGE_SIZE);
+
+        {
+            CharacterWorld worlds[2];
+            thread matches[2];
+            for (int match = 0; match < 2; ++match) {
+                matches[match] = thread([&worlds, match]() {
+                    for (int i = 0; i < 1000 * (match + 1); ++i) {
+                        worlds[match].spawn("Jack", 10, 20);
+                    }
+                    worlds[match].create("Leonardo da Vinci", 1000, 20);
+                });
+            }
+            for (thread &match : matches) {
+                match.join();
+            }
+            assert(worlds[0].getObjectCount() == 1001 && worlds[0].getIdCount() == 1001);
+            assert(worlds[1].getObjectCount() == 2001 && worlds[1].getIdCount() == 2001);
+            assert(worlds[1].store.ids[0] == 0 && worlds[1].pool.get(worlds[1].pool.find(2000)).getName() == "Leonardo da Vinci");
+            worlds[0].store.despawn(worlds[0].store.filter(query::id < 500));
+            assert(worlds[0].getObjectCount() == 501);
+            assert(GameCharacter::getObjectCount() == 0);
+            assert(GameCharacter::getIdCount() == 200016 + 10 * POOL_PAGE_SIZE);
+
+            CharacterWorld &standard = CharacterWorld::defaultWorld();
+            CharacterHandle handle = standard.spawn("Jack", 10, 20);
+            assert(GameCharacter::getObjectCount() == 1 && standard.getIdCount() == GameCharacter::getIdCount());
+            standard.store.despawn(standard.store.filter(query::id == standard.store.ids[standard.store.rowOf(handle)]));
+            assert(GameCharacter::getObjectCount() == 0);
+        }
+
+        {
+            CharacterWorld shard(5, 3);
+            CharacterHandle first = shard.spawn("Jack", 10, 20);
+            CharacterId id = shard.store.ids[shard.store.rowOf(first)];
+            assert(id == composeCharacterId(5, 3, false, 0) && id > 0);
+            assert(id >> (ID_EPOCH_BITS + 1 + ID_SEQUENCE_BITS) == 5 && shard.getIdCount() == 1);
+            assert(shard.store.count(query::id == id) == 1);
+
+            vector<CharacterId> minted[4];
+            thread minters[4];
+            for (int t = 0; t < 4; ++t) {
+                minters[t] = thread([&shard, &minted, t]() {
+                    IdMinter minter(shard.counters);
+                    for (int i = 0; i < ID_BLOCK_SIZE + 10; ++i) {
+                        minted[t].push_back(minter.mint());
+                    }
+                });
+            }
+            for (thread &minter : minters) {
+                minter.join();
+            }
+            vector<CharacterId> all;
+            for (vector<CharacterId> &ids : minted) {
+                all.insert(all.end(), ids.begin(), ids.end());
+            }
+            sort(all.begin(), all.end());
+            assert(adjacent_find(all.begin(), all.end()) == all.end() && all[0] > id);
+            assert(shard.counters.nextBlock == 8 && shard.getIdCount() == 1);
+
+            for (uint32_t bad : {1u << ID_NODE_BITS, 1u << ID_EPOCH_BITS}) {
+                try {
+                    CharacterWorld invalid(bad == 1u << ID_NODE_BITS ? bad : 0, bad == 1u << ID_EPOCH_BITS ? bad : 0);
+                    assert(false);
+                } catch (invalid_argument &) {
+                }
+            }
+            CharacterWorld exhausted(7, 0);
+            exhausted.counters.uniqueId = (1LL << ID_SEQUENCE_BITS) - 1;
+            exhausted.spawn("Jack", 10, 20);
+            try {
+                exhausted.spawn("Jack", 10, 20);
+                assert(false);
+            } catch (runtime_error &) {
+                assert(exhausted.store.size() == 1 && exhausted.store.ids[0] > 0);
+            }
+
+            CharacterWorld other(6, 0);
+            other.store.installMigration(shard.store.packMigration({0}), KEEP_IDS);
+            assert(other.store.ids[0] == id && other.getIdCount() == 0);
+            other.store.installMigration(other.store.packMigration({0}), KEEP_IDS);
+            assert(other.store.ids[1] == composeCharacterId(6, 0, false, 0) && other.getIdCount() == 1);
+            vector<CharacterId> local = minted[0];
+            CharacterWorld scratch(9, 0);
+            scratch.store.add("Jack", 10, 20, local[0]);
+            scratch.store.add("Jack", 10, 20, composeCharacterId(5, 3, true, 8 * ID_BLOCK_SIZE + 5));
+            shard.store.installMigration(scratch.store.packMigration({0, 1}), KEEP_IDS);
+            assert(shard.store.ids[1] != local[0] && shard.store.ids[2] == scratch.store.ids[1]);
+            assert(shard.counters.nextBlock == 9 && !shard.counters.mayBeLive(composeCharacterId(6, 0, true, 0)));
+        }
+
+        {
+            string path = "/tmp/character_ids_" + to_string(getpid()) + ".lease";
+            {
+                IdLeaseFile lease(path, 1000);
+                CharacterWorld world;
+                world.counters.useLease(&lease);
+                world.spawn("Jack", 10, 20);
+                world.spawn("Jack", 10, 20);
+                assert(world.store.ids[1] == 1 && lease.nextUnleased() == 1000);
+                IdMinter minter(world.counters);
+                assert(minter.mint() == composeCharacterId(0, 0, true, 0) && lease.nextUnleasedBlock() == ID_LEASE_BLOCKS);
+                world.store.installMigration(world.store.packMigration({0}), REMAP_IDS);
+                CharacterWorld origin;
+                origin.counters.uniqueId = 1500;
+                origin.spawn("Leia", 50, 60);
+                world.store.installMigration(origin.store.packMigration({0}), KEEP_IDS);
+                assert(world.store.ids[3] == 1500 && world.getIdCount() == 1501 && lease.nextUnleased() == 2501);
+            }
+            {
+                IdLeaseFile restarted(path, 1000);
+                assert(restarted.nextUnleased() == 2501 && restarted.nextUnleasedBlock() == ID_LEASE_BLOCKS);
+                CharacterWorld world;
+                world.counters.useLease(&restarted);
+                world.spawn("Jack", 10, 20);
+                assert(world.store.ids[0] == 2501 && restarted.nextUnleased() == 3501);
+                IdMinter minter(world.counters);
+                assert(minter.mint() == composeCharacterId(0, 0, true, ID_LEASE_BLOCKS * ID_BLOCK_SIZE));
+                assert(restarted.nextUnleasedBlock() == 2 * ID_LEASE_BLOCKS);
+            }
+            int fd = open(path.c_str(), O_WRONLY | O_TRUNC);
+            assert(fd >= 0 && write(fd, "not a lease file, keep me", 25) == 25);
+            close(fd);
+            try {
+                IdLeaseFile foreign(path);
+                assert(false);
+            } catch (runtime_error &) {
+            }
+            struct stat status;
+            assert(stat(path.c_str(), &status) == 0 && status.st_size == 25);
+            unlink(path.c_str());
+        }
+
+        {
+            CharacterWorld first, second;
+            vector<CharacterHandle> handles;
+            for (int i = 0; i < 3 * POOL_PAGE_SIZE; ++i) {
+                handles.push_back(first.create("Jack", 10 + i, i % 7));
+                second.create("Jack", 10 + i, i % 7);
+            }
+            uint64_t initial = first.checksum();
+            assert(initial != 0 && initial == second.checksum() && first.verifyChecksum());
+            first.pool.get(handles[5]).setName("Leonardo da Vinci");
+            first.pool.get(handles[9]).setName("Mage");
+            assert(first.checksum() != initial && first.verifyChecksum());
+            second.pool.get(second.pool.find(first.pool.get(handles[9]).getPersonalId())).setName("Mage");
+            second.pool.get(second.pool.find(first.pool.get(handles[5]).getPersonalId())).setName("Leonardo da Vinci");
+            assert(first.checksum() == second.checksum());
+            try {
+                first.pool.get(handles[5]).setName("leonardo");
+                assert(false);
+            } catch (invalid_argument &) {
+                assert(first.checksum() == second.checksum());
+            }
+
+            uint64_t beforeDefragment = first.checksum();
+            for (size_t i = 0; i < handles.size(); ++i) {
+                if (i % 3 != 0 && i != 5 && i != 9) {
+                    first.pool.destroy(handles[i]);
+                }
+            }
+            assert(first.checksum() != beforeDefragment && first.verifyChecksum());
+            uint64_t sparse = first.checksum();
+            while (!first.pool.defragment(chrono::microseconds(1000)).finished) {
+            }
+            assert(first.checksum() == sparse && first.verifyChecksum());
+            first.pool.get(handles[0]).health = 999;
+            assert(!first.verifyChecksum());
+            first.pool.get(handles[0]).health = 10;
+            assert(first.verifyChecksum());
+        }
+
+        {
+            CharacterWorld first, second;
+            vector<CharacterHandle> handles;
+            for (int i = 0; i < 300; ++i) {
+                handles.push_back(first.spawn("Jack", 10 + i, i % 7));
+                second.spawn("Jack", 10 + i, i % 7);
+            }
+            uint64_t initial = first.checksum();
+            assert(initial != 0 && initial == second.checksum() && first.verifyChecksum());
+            first.rename(handles[5], "Leia");
+            first.damage(handles[6], 7);
+            assert(first.checksum() != initial && first.verifyChecksum());
+            second.damage(second.store.find(first.store.ids[first.store.rowOf(handles[6])]), 7);
+            second.rename(second.store.find(first.store.ids[first.store.rowOf(handles[5])]), "Leia");
+            assert(first.checksum() == second.checksum());
+            using namespace query;
+            assert(first.store.update(health, health - 20, attackPower == 3) > 0);
+            assert(first.checksum() != second.checksum() && first.verifyChecksum());
+            second.store.update(health, health - 20, attackPower == 3);
+            assert(first.checksum() == second.checksum());
+            first.despawn(handles[7]);
+            first.store.despawn(first.store.filter(health < 40));
+            assert(first.verifyChecksum() && first.checksum() != second.checksum());
+            first.store.health[0] = 999;
+            assert(!first.verifyChecksum());
+        }
+
+        {
+            auto state = [](const CharacterWorld &world) {
+                vector<string> rows;
+                for (size_t row = 0; row < world.store.size(); ++row) {
+                    rows.push_back(to_string(world.store.ids[row]) + world.store.names[row] + " "
+                                   + to_string(world.store.health[row]) + " " + to_string(world.store.attackPower[row]));
+                }
+                world.pool.forEach([&](GameCharacter &character) {
+                    rows.push_back("pooled " + to_string(character.id) + character.toString());
+                });
+                sort(rows.begin(), rows.end());
+                return rows;
+            };
+            CharacterWorld recorded;
+            ReplayRecorder recorder(recorded.counters, 4);
+            recorded.record(&recorder);
+            vector<vector<string>> states = {state(recorded)};
+            vector<CharacterHandle> live, pooled;
+            uint32_t seed = 4242;
+            size_t operations = 0;
+            for (int tick = 0; tick < 21; ++tick) {
+                for (int operation = 0; operation < 30; ++operation) {
+                    seed = seed * 1664525 + 1013904223;
+                    int kind = live.size() < 5 ? 0 : (seed >> 8) % 4;
+                    size_t victim = live.empty() ? 0 : (seed >> 12) % live.size();
+                    if (kind == 0) {
+                        live.push_back(recorded.spawn("Jack", seed % 5 == 0 ? -1 : 1 + (seed >> 4) % 100, (seed >> 16) % 50));
+                    } else if (kind == 1) {
+                        recorded.rename(live[victim], seed % 2 ? "Leonardo da Vinci" : "Mage");
+                    } else if (kind == 2) {
+                        recorded.damage(live[victim], (seed >> 20) % 30);
+                    } else {
+                        recorded.despawn(live[victim]);
+                        live.erase(live.begin() + victim);
+                    }
+                    ++operations;
+                }
+                pooled.push_back(recorded.create("Mage", 1 + tick, tick));
+                recorded.pool.get(pooled[tick > 0 ? tick - 1 : 0]).setName("Leia");
+                operations += 2;
+                if (tick % 3 == 2) {
+                    recorded.pool.destroy(pooled[tick - 2]);
+                    ++operations;
+                }
+                using namespace query;
+                operations += recorded.store.update(health, health - 15, attackPower < 10 && health > 0);
+                vector<uint64_t> dead = recorded.store.filter(health == 0);
+                live.erase(remove_if(live.begin(), live.end(), [&](CharacterHandle handle) {
+                    return recorded.store.health[recorded.store.rowOf(handle)] == 0;
+                }), live.end());
+                operations += recorded.store.despawn(dead);
+                recorded.endTick();
+                states.push_back(state(recorded));
+            }
+            assert(recorder.tickCount() == 21 && recorded.getObjectCount() == (int)(live.size() + recorded.pool.size()));
+
+            CharacterWorld played;
+            ReplayPlayer player(recorder.data());
+            assert(player.playAll(played) == operations && player.tick() == 21);
+            assert(state(played) == states[21] && played.getIdCount() == recorded.getIdCount());
+            assert(played.checksum() == recorded.checksum() && played.verifyChecksum());
+            size_t hooked = 0, rows = played.store.size();
+            played.onDespawn([&](CharacterHandle) {
+                ++hooked;
+            });
+            for (uint64_t target : {13, 2, 8, 0, 21}) {
+                player.seek(played, target);
+                assert(player.tick() == target && state(played) == states[target]);
+            }
+            assert(hooked >= rows && rows > 0);
+            played.spawn("Jack", 1, 1);
+            assert(played.store.ids[played.store.size() - 1] == recorded.counters.mintId());
+            try {
+                player.seek(played, 22);
+                assert(false);
+            } catch (invalid_argument &) {
+            }
+            CharacterWorld standalone;
+            ReplayRecorder journal(standalone.counters);
+            standalone.record(&journal);
+            standalone.spawn("Jack", 10, 1);
+            {
+                GameCharacter solo(standalone.counters, "Solo", 10, 1);
+                solo.setName("Lone");
+            }
+            standalone.endTick();
+            CharacterWorld replayed;
+            assert(ReplayPlayer(journal.data()).playAll(replayed) == 1 && replayed.store.names == standalone.store.names);
+            vector<uint8_t> corrupt = recorder.data();
+            corrupt[11] = 0x7f;
+            try {
+                ReplayPlayer broken(corrupt);
+                assert(false);
+            } catch (invalid_argument &) {
+            }
+        }
+
+        {
+            VersionedColumns versioned(3 * MVCC_CHUNK);
+            for (int i = 0; i < 2 * MVCC_CHUNK + 100; ++i) {
+                versioned.append(i, 100, i % 50);
+            }
+            assert(versioned.pin().size() == 0);
+            versioned.commit();
+            {
+                VersionedColumns::ReadView before = versioned.pin();
+                versioned.setHealth(5, 40);
+                versioned.swapRemove(7);
+                assert(before.getHealth(5) == 100 && before.getPersonalId(7) == 7 && versioned.versionCount() == 5);
+                versioned.commit();
+                VersionedColumns::ReadView after = versioned.pin();
+                assert(before.size() == 2 * MVCC_CHUNK + 100 && after.size() == 2 * MVCC_CHUNK + 99);
+                assert(after.getHealth(5) == 40 && after.getPersonalId(7) == 2 * MVCC_CHUNK + 99 && before.getHealth(5) == 100);
+            }
+            versioned.commit();
+            assert(versioned.versionCount() == 3);
+
+            const int64_t total = (int64_t)versioned.size() * 100 - 60;
+            atomic<bool> done(false);
+            atomic<int> scans(0);
+            vector<thread> readers;
+            for (int r = 0; r < 3; ++r) {
+                readers.emplace_back([&]() {
+                    while (!done || scans < 3) {
+                        VersionedColumns::ReadView view = versioned.pin();
+                        int64_t sum = 0;
+                        view.forEachChunk([&](size_t, size_t rows, const int *health, const int *, const CharacterId *) {
+                            for (size_t row = 0; row < rows; ++row) {
+                                sum += health[row];
+                            }
+                        });
+                        assert(sum == total);
+                        ++scans;
+                    }
+                });
+            }
+            uint32_t seed = 5;
+            for (int tick = 0; tick < 300; ++tick) {
+                for (int transfer = 0; transfer < 20; ++transfer) {
+                    seed = seed * 1664525 + 1013904223;
+                    size_t from = (seed >> 8) % versioned.size(), to = (seed >> 16) % versioned.size();
+                    VersionedColumns::ReadView current = versioned.pin();
+                    int amount = min(current.getHealth(from), (int)(seed % 7));
+                    int target = current.getHealth(to);
+                    if (from != to) {
+                        versioned.setHealth(from, current.getHealth(from) - amount);
+                        versioned.setHealth(to, target + amount);
+                        versioned.commit();
+                    }
+                }
+            }
+            done = true;
+            for (thread &reader : readers) {
+                reader.join();
+            }
+            versioned.commit();
+            assert(versioned.versionCount() == 3);
+        }
+
+        {
+            CharacterWorld world;
+            vector<CharacterHandle> handles;
+            for (int i = 0; i < 3 * MVCC_CHUNK; ++i) {
+                handles.push_back(world.spawn("Jack", 100, i % 50));
+            }
+            VersionedColumns versioned(4 * MVCC_CHUNK);
+            assert(versioned.sync(world.store) == 3 && versioned.sync(world.store) == 0);
+            versioned.commit();
+            VersionedColumns::ReadView before = versioned.pin();
+            world.damage(handles[MVCC_CHUNK + 5], 30);
+            world.despawn(handles[7]);
+            assert(versioned.sync(world.store) == 3);
+            world.store.update(query::attackPower, query::Constant(1), query::id == world.store.ids[2 * MVCC_CHUNK]);
+            assert(versioned.sync(world.store) == 1);
+            versioned.commit();
+            VersionedColumns::ReadView after = versioned.pin();
+            assert(before.size() == 3 * MVCC_CHUNK && after.size() == 3 * MVCC_CHUNK - 1);
+            for (size_t row = 0; row < world.store.size(); ++row) {
+                assert(after.getPersonalId(row) == world.store.ids[row] && after.getHealth(row) == world.store.health[row]
+                       && after.getAttackPower(row) == world.store.attackPower[row]);
+            }
+            assert(before.getHealth(MVCC_CHUNK + 5) == 100 && after.getHealth(MVCC_CHUNK + 5) == 70);
+        }
+
+        {
+            CharacterWorld world;
+            for (int i = 0; i < 3 * SNAPSHOT_CHUNK; ++i) {
+                world.spawn("Jack", 10 + i % 90, i % 50);
+            }
+            SnapshotPublisher publisher(world.store, 2);
+            shared_ptr<const PopulationSnapshot> first = publisher.acquire();
+            weak_ptr<const PopulationSnapshot> expired = first;
+            assert(first->size() == 3 * SNAPSHOT_CHUNK && first->chunks.size() == 3 && publisher.getRebuiltChunks() == 3);
+
+            world.rename(world.store.find(world.store.ids[SNAPSHOT_CHUNK + 1]), "Mage");
+            publisher.endTick();
+            assert(publisher.acquire() == first);
+            publisher.endTick();
+            shared_ptr<const PopulationSnapshot> second = publisher.acquire();
+            assert(second != first && second->tick == 2 && publisher.getRebuiltChunks() == 4);
+            assert(second->chunks[0] == first->chunks[0] && second->chunks[1] != first->chunks[1]);
+            assert(first->getName(SNAPSHOT_CHUNK + 1) == "Jack" && second->getName(SNAPSHOT_CHUNK + 1) == "Mage");
+
+            world.damage(world.store.find(world.store.ids[5]), 3);
+            world.despawn(world.store.find(world.store.ids[3 * SNAPSHOT_CHUNK - 1]));
+            assert(publisher.publish() == 2);
+            shared_ptr<const PopulationSnapshot> third = publisher.acquire();
+            assert(third->size() == 3 * SNAPSHOT_CHUNK - 1 && third->getHealth(5) == 12 && second->getHealth(5) == 15);
+            assert(third->chunks[1] == second->chunks[1] && third->getPersonalId(7) == world.store.ids[7]);
+
+            assert(!expired.expired());
+            first.reset();
+            assert(expired.expired() && second->getName(SNAPSHOT_CHUNK + 1) == "Mage");
+
+            atomic<bool> done(false);
+            thread reader([&]() {
+                while (!done) {
+                    shared_ptr<const PopulationSnapshot> snapshot = publisher.acquire();
+                    int64_t alive = 0;
+                    for (const shared_ptr<const SnapshotChunk> &chunk : snapshot->chunks) {
+                        alive += count_if(chunk->health.begin(), chunk->health.end(), [](int health) {
+                            return health != 0;
+                        });
+                    }
+                    assert(alive == (int64_t)snapshot->size());
+                }
+            });
+            for (int tick = 0; tick < 100; ++tick) {
+                world.damage(world.store.find(world.store.ids[tick * 97 % world.store.size()]), 1);
+                publisher.endTick();
+            }
+            done = true;
+            reader.join();
+            try {
+                SnapshotPublisher never(world.store, 0);
+                assert(false);
+            } catch (invalid_argument &) {
+            }
+        }
+
+        {
+            string roster;
+            for (int i = 0; i < 1000; ++i) {
+                roster += i == 10 ? "leonardo,10,20\n" : i == 20 ? "Jack,ten,20\r\n" : i == 30 ? "\n" : "Jack,10,20\n";
+            }
+            roster += "Leonardo da Vinci,-1,500";
+            CharacterWorld world;
+            ReplayRecorder recorder(world.counters);
+            world.record(&recorder);
+            ImportJob job(world, roster);
+            ImportProgress progress = job.run(chrono::microseconds(0));
+            assert(progress.imported == IMPORT_CLOCK_INTERVAL - 3 && !progress.finished && progress.fraction() < 0.1);
+            int slices = 1;
+            while (!job.run(chrono::microseconds(0)).finished) {
+                ++slices;
+            }
+            progress = job.progress();
+            assert(slices == 1000 / IMPORT_CLOCK_INTERVAL && progress.imported == 998 && progress.rejected == 2);
+            assert(progress.fraction() == 1.0 && world.getObjectCount() == 998 && world.getIdCount() == 0);
+            assert(job.errors().size() == 2 && job.errors()[0] == "line 11: Name must start with an uppercase letter.");
+            assert(job.errors()[1] == "line 21: Expected name,health,attackPower.");
+            assert(world.store.names[997] == "Leonardo da Vinci" && world.store.health[997] == -1);
+            assert(world.store.ids[0] == composeCharacterId(0, 0, true, 0) && world.counters.nextBlock == 1);
+            assert(adjacent_find(world.store.ids.begin(), world.store.ids.end()) == world.store.ids.end());
+            try {
+                world.spawn("Jack", 10, 20, world.store.ids[5]);
+                assert(false);
+            } catch (invalid_argument &) {
+                assert(world.getObjectCount() == 998);
+            }
+            world.endTick();
+            CharacterWorld played;
+            ReplayPlayer(recorder.data()).playAll(played);
+            assert(played.store.ids == world.store.ids && played.store.names == world.store.names);
+            assert(played.checksum() == world.checksum() && world.verifyChecksum());
+        }
+
+        {
+            CharacterWorld world;
+            ReplayRecorder recorder(world.counters);
+            world.record(&recorder);
+            SpatialGrid grid(10);
+            CharacterHandle alice = world.spawn("Alice", 100, 10), bob = world.spawn("Bob", 50, 20);
+            CharacterHandle carol = world.spawn("Carol", -1, 5), dave = world.spawn("Dave", 30, 40);
+            grid.place(alice, 0, 0);
+            grid.place(bob, 3, 4);
+            grid.place(carol, -4, 0);
+            grid.place(dave, 100, 100);
+            vector<CharacterHandle> found;
+            grid.queryRadius(0, 0, 5, found);
+            assert(found.size() == 3 && find(found.begin(), found.end(), dave) == found.end());
+            grid.queryBox(-5, -5, 0, 0, found);
+            assert(found.size() == 2 && find(found.begin(), found.end(), bob) == found.end());
+            vector<AreaAttack> attacks = {{alice, 5}, {bob, 6}, {dave, 1}};
+            assert(resolveAreaAttacks(world, grid, attacks) == 3);
+            assert(world.store.health[world.store.rowOf(alice)] == 80 && world.store.health[world.store.rowOf(bob)] == 40);
+            assert(world.store.health[world.store.rowOf(carol)] == -1 && world.store.health[world.store.rowOf(dave)] == 30);
+            grid.place(dave, 1, 1);
+            attacks = {{alice, 3}, {carol, 6}};
+            assert(resolveAreaAttacks(world, grid, attacks) == 2);
+            assert(world.store.health[world.store.rowOf(dave)] == 15 && world.store.health[world.store.rowOf(alice)] == 75);
+            assert(world.verifyChecksum());
+            world.endTick();
+            CharacterWorld played;
+            ReplayPlayer(recorder.data()).playAll(played);
+            assert(played.store.health == world.store.health && played.checksum() == world.checksum());
+            try {
+                world.damage({alice, CharacterHandle{alice.slot, alice.generation + 1}}, {1, 1});
+                assert(false);
+            } catch (invalid_argument &) {
+                assert(world.store.health[world.store.rowOf(alice)] == 75 && world.verifyChecksum());
+            }
+            world.despawn(bob);
+            CharacterHandle eve = world.spawn("Eve", 10, 1);
+            grid.place(eve, 50, 50);
+            assert(!grid.contains(bob) && grid.contains(eve));
+            grid.queryRadius(3, 4, 1, found);
+            assert(found.empty());
+            grid.remove(dave);
+            grid.queryRadius(0, 0, 2, found);
+            assert(found.size() == 1 && found[0] == alice);
+            try {
+                grid.place(eve, NAN, 0);
+                assert(false);
+            } catch (invalid_argument &) {
+                assert(grid.getX(eve) == 50);
+            }
+            grid.place(eve, 3e38f, -3e38f);
+            grid.queryBox(1e38f, -FLT_MAX, FLT_MAX, -1e38f, found);
+            assert(found.size() == 1 && found[0] == eve);
+            grid.queryBox(-FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX, found);
+            assert(found.size() == 3);
+            grid.queryBox(NAN, NAN, NAN, NAN, found);
+            assert(found.empty());
+            CharacterHandle frank = world.spawn("Frank", 10, -5);
+            grid.place(frank, 0, 1);
+            attacks = {{frank, 5}};
+            assert(resolveAreaAttacks(world, grid, attacks) == 0 && world.store.health[world.store.rowOf(alice)] == 75);
+            try {
+                world.damage(alice, -1);
+                assert(false);
+            } catch (invalid_argument &) {
+                assert(world.store.health[world.store.rowOf(alice)] == 75);
+            }
+            for (size_t buckets : {size_t(0), size_t(3), size_t(96)}) {
+                try {
+                    SpatialGrid invalid(10, buckets);
+                    assert(false);
+                } catch (invalid_argument &) {
+                }
+            }
+
+            SpatialGrid small(4, 64);
+            vector<float> xs(2000), ys(2000);
+            uint64_t seed = 7;
+            auto next = [&seed]() {
+                seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                return (float)((seed >> 33) % 20000) / 100 - 100;
+            };
+            for (int round = 0; round < 5; ++round) {
+                for (uint32_t slot = 0; slot < 2000; ++slot) {
+                    xs[slot] = next();
+                    ys[slot] = next();
+                    small.place(CharacterHandle{slot, 0}, xs[slot], ys[slot]);
+                }
+                float centerX = next(), centerY = next();
+                small.queryRadius(centerX, centerY, 25, found);
+                size_t expected = 0;
+                for (uint32_t slot = 0; slot < 2000; ++slot) {
+                    float dx = xs[slot] - centerX, dy = ys[slot] - centerY;
+                    expected += dx * dx + dy * dy <= 625;
+                }
+                assert(found.size() == expected);
+            }
+        }
+
+        {
+            CharacterWorld world;
+            CharacterHandle alice = world.spawn("Alice", 100, 10), bob = world.spawn("Bob", 20, 5);
+            SpatialGrid grid(10);
+            grid.place(alice, 0, 0);
+            grid.place(bob, 1, 1);
+            world.onDespawn([&](CharacterHandle handle) {
+                grid.remove(handle);
+            });
+            SnapshotPublisher publisher(world.store);
+            SimulationLoop loop(world, chrono::milliseconds(10), LATE_CATCH_UP, 3);
+            loop.publishTo(&publisher);
+            loop.addSystem([&](CharacterWorld &simulated, uint64_t) {
+                if (simulated.store.contains(bob)) {
+                    simulated.damage(bob, 10);
+                }
+            });
+            loop.command([&](CharacterWorld &simulated) {
+                simulated.rename(alice, "Alicia");
+            });
+            assert(loop.advance(chrono::milliseconds(5)) == 0 && world.store.names[0] == "Alice");
+            assert(loop.advance(chrono::milliseconds(5)) == 1 && world.store.names[0] == "Alicia");
+            assert(world.store.health[world.store.rowOf(bob)] == 10);
+            assert(loop.advance(chrono::milliseconds(25)) == 2 && loop.getTick() == 3);
+            assert(!world.store.contains(bob) && world.getObjectCount() == 1 && publisher.acquire()->size() == 1);
+            assert(!grid.contains(bob) && grid.contains(alice) && world.verifyChecksum());
+            assert(loop.advance(chrono::milliseconds(100)) == 3 && loop.getTick() == 6 && loop.getDroppedTicks() == 7);
+            assert(loop.getTimingCount() == 6 && loop.getTiming(3).dropped == 7 && loop.getTiming(4).dropped == 0);
+            assert(loop.getTiming(5).population == 1 && loop.getTiming(0).population == 2);
+            loop.setBudget(PHASE_SYSTEMS, chrono::microseconds(0));
+            loop.addSystem([](CharacterWorld &, uint64_t) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            });
+            loop.tick();
+            const TickTiming &late = loop.getTiming(loop.getTimingCount() - 1);
+            assert(late.overBudget == 1u << PHASE_SYSTEMS && late.phases[PHASE_SYSTEMS] >= 1 && late.total >= 1);
+            ostringstream csv;
+            loop.writeTimings(csv);
+            string series = csv.str();
+            assert(series.rfind("tick,population,input_ms,systems_ms,cleanup_ms,publish_ms,total_ms,dropped,over_budget\n", 0) == 0);
+            assert(count(series.begin(), series.end(), '\n') == 8 && series.find(",0,systems\n") != string::npos);
+
+            SimulationLoop dropping(world, chrono::milliseconds(10), LATE_DROP);
+            assert(dropping.advance(chrono::milliseconds(35)) == 1 && dropping.getDroppedTicks() == 2);
+            SimulationLoop bounded(world, chrono::milliseconds(1), LATE_CATCH_UP, 1, 4);
+            for (int tick = 0; tick < 6; ++tick) {
+                bounded.tick();
+            }
+            assert(bounded.getTimingCount() == 4 && bounded.getTiming(0).tick == 2 && bounded.getTiming(3).tick == 5);
+            csv.str("");
+            bounded.writeTimings(csv);
+            series = csv.str();
+            assert(count(series.begin(), series.end(), '\n') == 5 && series.find("\n2,1,") != string::npos);
+            bounded.clearTimings();
+            assert(bounded.getTimingCount() == 0 && bounded.getTick() == 6);
+            SimulationLoop simulated(world, chrono::milliseconds(1));
+            chrono::steady_clock::time_point now;
+            LoopClock clock;
+            clock.now = [&]() {
+                return now;
+            };
+            clock.sleepUntil = [&](chrono::steady_clock::time_point until) {
+                now = max(now, until);
+            };
+            simulated.setClock(clock);
+            assert(simulated.runFor(chrono::milliseconds(20)) == 20 && simulated.getTick() == 20);
+            assert(simulated.getDroppedTicks() == 0 && now == chrono::steady_clock::time_point(chrono::milliseconds(20)));
+            try {
+                SimulationLoop invalid(world, chrono::microseconds(0));
+                assert(false);
+            } catch (invalid_argument &) {
+            }
+        }
+
+        {
+            CharacterWorld world;
+            TiledCharacterStore<8> tiled(world.counters);
+            for (int i = 0; i < 20; ++i) {
+                tiled.add("Jack", 10 + i, i);
+            }
+            assert(tiled.size() == 20 && tiled.tileCount() == 3 && world.getObjectCount() == 20);
+            assert(tiled.getHealth(9) == 19 && tiled.getAttackPower(17) == 17 && tiled.getPersonalId(19) == 19);
+            tiled.setName(9, "Leonardo da Vinci");
+            assert(tiled.getName(9) == "Leonardo da Vinci" && tiled.getName(8) == "Jack");
+            try {
+                tiled.setName(9, "leonardo");
+                assert(false);
+            } catch (invalid_argument &) {
+                assert(tiled.getName(9) == "Leonardo da Vinci");
+            }
+            size_t rows = 0;
+            int64_t health = 0;
+            tiled.forEachTile([&](const CharacterTile<8> &tile, size_t count) {
+                rows += count;
+                for (size_t lane = 0; lane < 8; ++lane) {
+                    health += tile.health[lane];
+                }
+            });
+            assert(rows == 20 && health == 20 * 10 + 190);
+            tiled.forEachTile([](CharacterTile<8> &tile, size_t) {
+                fill(tile.health, tile.health + 8, 5);
+            });
+            health = 0;
+            tiled.forEachTile([&](const CharacterTile<8> &tile, size_t) {
+                for (size_t lane = 0; lane < 8; ++lane) {
+                    health += tile.health[lane];
+                }
+            });
+            assert(health == 20 * 5);
+        }
+
+        {
+            vector<string> kernelNames = {"Jack", "leonardo", "Ja  ck", "Jack ", "", "Leonardo da Vinci", "J4ck", "Mage"};
+            vector<int> kernelHealth, kernelAttackPower, kernelDamage;
+            for (int i = 0; i < 37; ++i) {
+                kernelHealth.push_back(i % 5 == 0 ? -1 : 1 + i * 29 % MAX_HEALTH);
+                kernelAttackPower.push_back(i * 13 % (MAX_POWER + 1));
+                kernelDamage.push_back(i * 7 % 40);
+            }
+            const CharacterKernels &scalar = selectKernels("scalar");
+            assert(string(scalar.name) == "scalar" && supportedKernels()[0] == &scalar);
+            const CharacterKernels &fastest = selectKernels(nullptr);
+            assert(&selectKernels("") == &fastest && &fastest == supportedKernels().back());
+            try {
+                selectKernels("bogus");
+                assert(false);
+            } catch (invalid_argument &e) {
+                assert(string(e.what()) == "Kernel variant bogus is not supported on this CPU.");
+            }
+            assert(&bindKernels("scalar") == &scalar && &bindKernels("bogus") == &fastest);
+            assert(&characterKernels() == &bindKernels(getenv(CHARACTER_KERNELS_VARIABLE)));
+            const char *forced = getenv(CHARACTER_KERNELS_VARIABLE);
+            string previous = forced == nullptr ? "" : forced;
+            setenv(CHARACTER_KERNELS_VARIABLE, "scalar", 1);
+            assert(&bindKernels(getenv(CHARACTER_KERNELS_VARIABLE)) == &scalar);
+            setenv(CHARACTER_KERNELS_VARIABLE, "avx512", 1);
+            assert(&bindKernels(getenv(CHARACTER_KERNELS_VARIABLE)) == &fastest);
+            if (forced == nullptr) {
+                unsetenv(CHARACTER_KERNELS_VARIABLE);
+            } else {
+                setenv(CHARACTER_KERNELS_VARIABLE, previous.c_str(), 1);
+            }
+            for (const CharacterKernels *kernels : supportedKernels()) {
+                assert(&selectKernels(kernels->name) == kernels);
+                for (size_t count : {(size_t)0, (size_t)1, (size_t)7, (size_t)37}) {
+                    vector<NameCheck> expectedChecks(kernelNames.size()), checks(kernelNames.size());
+                    size_t nameCount = min(count, kernelNames.size());
+                    scalar.checkNames(kernelNames.data(), nameCount, expectedChecks.data());
+                    kernels->checkNames(kernelNames.data(), nameCount, checks.data());
+                    assert(checks == expectedChecks);
+
+                    vector<int> expected = kernelHealth, actual = kernelHealth;
+                    scalar.applyDamage(expected.data(), kernelDamage.data(), count);
+                    kernels->applyDamage(actual.data(), kernelDamage.data(), count);
+                    assert(actual == expected);
+                    assert(kernels->totalHealth(actual.data(), count) == scalar.totalHealth(expected.data(), count));
+
+                    vector<uint32_t> expectedPacked(2 * count), packed(2 * count);
+                    scalar.packStats(expected.data(), kernelAttackPower.data(), count, expectedPacked.data());
+                    kernels->packStats(actual.data(), kernelAttackPower.data(), count, packed.data());
+                    assert(packed == expectedPacked);
+                }
+            }
+            vector<int> damaged = {-1, 10, 5};
+            scalar.applyDamage(damaged.data(), vector<int>{50, 3, 50}.data(), 3);
+            assert(damaged == vector<int>({-1, 7, 0}) && scalar.totalHealth(damaged.data(), 3) == 7);
+            try {
+                selectKernels("quantum");
+                assert(false);
+            } catch (invalid_argument &) {
+            }
+        }
+
+        {
+            CharacterWorld world;
+            for (int i = 0; i < 3000; ++i) {
+                world.spawn(i % 3 ? "Jack" : "Leonardo da Vinci", 1 + i % 7, i % 50);
+            }
+            vector<uint8_t> raw = world.store.packMigration(world.store.select(query::health > 0));
+            vector<uint8_t> packed = compressBlocks(raw, 4096, 3);
+            CompressedBlocks blocks(packed);
+            assert(blocks.rawSize() == raw.size() && blocks.blockCount() == (raw.size() + 4095) / 4096);
+            assert(packed.size() * 2 < raw.size() && blocks.decompressAll(2) == raw);
+            vector<uint8_t> third(blocks.blockLength(2));
+            blocks.decompress(2, third.data());
+            assert(equal(third.begin(), third.end(), raw.begin() + 2 * 4096));
+
+            vector<uint8_t> noise(10000);
+            uint32_t seed = 7;
+            for (uint8_t &byte : noise) {
+                seed = seed * 1664525 + 1013904223;
+                byte = (uint8_t)(seed >> 24);
+            }
+            vector<uint8_t> stored = compressBlocks(noise, 4096);
+            assert(stored.size() == 20 + 3 * 4 + noise.size() && CompressedBlocks(stored).decompressAll() == noise);
+            assert(CompressedBlocks(compressBlocks({})).decompressAll().empty());
+            vector<uint8_t> oversized = compressBlocks(noise, 4096);
+            oversized[7] = 0x40;
+            try {
+                CompressedBlocks huge(oversized);
+                assert(false);
+            } catch (invalid_argument &e) {
+                assert(string(e.what()) == "Compressed block header is corrupt.");
+            }
+            packed[40] ^= 0x55;
+            try {
+                CompressedBlocks(packed).decompressAll();
+                assert(false);
+            } catch (invalid_argument &) {
+            }
+        }
+
+        {
+            CharacterWorld world;
+            world.spawn("Jack", 10, 20);
+            world.spawn("Leonardo da Vinci", -1, 500);
+            world.spawn("Mage", 300, 0);
+            ColumnarBatch exported = exportColumnarBatch(world.store, 1, 3);
+            assert(exported.length == 2 && exported.health == world.store.health.data() + 1);
+            assert(exported.getName(0) == "Leonardo da Vinci" && exported.nameOffsets[2] == 21);
+            ColumnarBatch copied;
+            {
+                ColumnarBatch temporary = exportColumnarBatch(world.store, 0, 3);
+                copied = temporary;
+            }
+            ColumnarBatch moved(move(copied));
+            assert(moved.getName(2) == "Mage" && moved.getName(0) == "Jack" && moved.health == world.store.health.data());
+            assert(copied.length == 0 && copied.nameOffsets == nullptr);
+
+            string path = "/tmp/characters_" + to_string(getpid()) + ".columns";
+            int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            assert(fd >= 0);
+            writeColumnar(fd, world.store, 2);
+            vector<uint8_t> bytes(lseek(fd, 0, SEEK_END));
+            assert(pread(fd, bytes.data(), bytes.size(), 0) == (ssize_t)bytes.size());
+            close(fd);
+
+            {
+                fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+                writeColumnar(fd, world.store, 2);
+                close(fd);
+                MappedFile mapped(path);
+                ColumnarFile snapshot(mapped.data(), mapped.length());
+                CharacterWorld restoredWorld;
+                CharacterStore &store = restoredWorld.store;
+                vector<CharacterHandle> restored = store.restoreColumnar(snapshot);
+                assert(store.size() == 3 && restoredWorld.getObjectCount() == 3 && restoredWorld.getIdCount() == 3);
+                assert(store.health[1] == -1 && store.ids[2] == world.store.ids[2]);
+                assert(store.getNameMetrics().restored == 3 && store.getNameMetrics().touched == 0);
+                assert(restoredWorld.checksum() == world.checksum() && restoredWorld.verifyChecksum());
+                assert(store.select(query::nameStartsWith("Leo")) == vector<uint32_t>({1}));
+                assert(store.getName(restored[1]) == "Leonardo da Vinci" && store.getName(restored[1]) == "Leonardo da Vinci");
+                restoredWorld.rename(restored[2], "Jack");
+                assert(store.getName(restored[2]) == "Jack" && store.getNameMetrics().touched == 2);
+                try {
+                    restoredWorld.rename(restored[0], "Ja  ck");
+                    assert(false);
+                } catch (invalid_argument &) {
+                    assert(store.getNameMetrics().touched == 2 && store.getName(restored[0]) == "Jack");
+                }
+                restoredWorld.despawn(restored[1]);
+                assert(store.getName(store.find(world.store.ids[2])) == "Jack" && restoredWorld.verifyChecksum());
+                try {
+                    store.restoreColumnar(snapshot);
+                    assert(false);
+                } catch (invalid_argument &) {
+                    assert(store.size() == 2 && restoredWorld.getObjectCount() == 2);
+                }
+                store.despawn(store.filter(query::Constant(1)));
+                assert(store.restoreColumnar(snapshot).size() == 3 && store.has(world.store.ids[1]));
+            }
+            unlink(path.c_str());
+            {
+                vector<uint8_t> damaged = bytes;
+                size_t name = search(damaged.begin(), damaged.end(), (const uint8_t *)"Mage", (const uint8_t *)"Mage" + 4) - damaged.begin();
+                damaged[name] = 'm';
+                ColumnarFile snapshot(damaged);
+                CharacterWorld restoredWorld;
+                vector<CharacterHandle> restored = restoredWorld.store.restoreColumnar(snapshot);
+                try {
+                    restoredWorld.store.getName(restored[2]);
+                    assert(false);
+                } catch (invalid_argument &) {
+                    assert(restoredWorld.store.getName(restored[0]) == "Jack");
+                }
+                damaged[name] = 'M';
+                damaged[name + 3] = 'i';
+                ColumnarFile renamed(damaged);
+                CharacterWorld renamedWorld;
+                restored = renamedWorld.store.restoreColumnar(renamed);
+                assert(renamedWorld.checksum() == world.checksum() && !renamedWorld.verifyChecksum());
+                try {
+                    renamedWorld.store.packMigration({0, 2});
+                    assert(false);
+                } catch (invalid_argument &) {
+                }
+                try {
+                    renamedWorld.store.getName(restored[2]);
+                    assert(false);
+                } catch (invalid_argument &) {
+                    assert(renamedWorld.store.packMigration({0, 1}).size() > 0);
+                }
+                size_t offsets = (const uint8_t *)ColumnarFile(damaged).batch(0).nameOffsets - damaged.data();
+                vector<uint8_t> overlapping = damaged, huge = damaged;
+                memcpy(&overlapping[offsets + 4], "\x00\x00\x00\x40", 4);
+                memcpy(&huge[offsets - 16], "\xff\xff\xff\xff\xff\xff\xff\x3f", 8);
+                for (const vector<uint8_t> *corrupt : {&overlapping, &huge}) {
+                    try {
+                        ColumnarFile(*corrupt).batch(0);
+                        assert(false);
+                    } catch (invalid_argument &) {
+                    }
+                }
+            }
+
+            ColumnarFile file(bytes);
+            assert(file.batchCount() == 2);
+            ColumnarBatch first = file.batch(0), second = file.batch(1);
+            assert(first.length == 2 && second.length == 1 && (uintptr_t)first.health % 4 == 0);
+            assert(first.getName(1) == "Leonardo da Vinci" && first.health[1] == -1 && first.attackPower[1] == 500);
+            assert(second.getName(0) == "Mage" && second.ids[0] == world.store.ids[2]);
+            bytes[bytes.size() - 16] ^= 1;
+            try {
+                ColumnarFile corrupt(bytes);
+                assert(false);
+            } catch (invalid_argument &) {
+            }
+        }
     }
     catch (invalid_argument e) {
         cout << e.what() << endl;